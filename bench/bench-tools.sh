@@ -0,0 +1,77 @@
+#!/bin/sh -e
+# Throughput of the tools over inputs from viv-gen, the same on every run
+# for the same SIZE.  Run by "make bench"; the device benchmarks run on the
+# mock device.
+#
+#   bench-tools.sh DATADIR SIZE
+DIR="$1"
+SIZE="$2"
+W=4096
+H=4096
+
+report() {
+	awk -v n="$1" -v b="$2" -v ns="$3" 'BEGIN {
+		printf "  %-24s %10.3f s %10.1f MB/s\n", n, ns / 1e9, b / ns * 1e3
+	}'
+}
+
+# run NAME BYTES COMMAND...: BYTES read
+run() {
+	name="$1"
+	bytes="$2"
+	shift 2
+	t0=`date +%s%N`
+	"$@" > /dev/null
+	t1=`date +%s%N`
+	report "$name" "$bytes" $((t1 - t0))
+}
+
+# gen NAME FILE COMMAND...: FILE written
+gen() {
+	name="$1"
+	file="$2"
+	shift 2
+	t0=`date +%s%N`
+	"$@"
+	t1=`date +%s%N`
+	report "$name" `wc -c < "$file"` $((t1 - t0))
+}
+
+mkdir -p "$DIR"
+
+echo "tools ($SIZE):"
+gen viv-gen-cmd "$DIR/cmd-1.bin" \
+	bench/viv-gen -s 1 -z "$SIZE" cmd "$DIR/cmd-1.bin"
+bench/viv-gen -s 2 -z "$SIZE" cmd "$DIR/cmd-2.bin"
+gen viv-gen-dump "$DIR/dump.bin" \
+	bench/viv-gen -s 3 -z "$SIZE" dump "$DIR/dump.bin"
+bench/viv-gen -s 4 -w $W -h $H surface "$DIR/surface-1.bin"
+bench/viv-gen -s 5 -w $W -h $H surface "$DIR/surface-2.bin"
+
+cmd=`wc -c < "$DIR/cmd-1.bin"`
+dump=`wc -c < "$DIR/dump.bin"`
+surface=`wc -c < "$DIR/surface-1.bin"`
+
+run viv-cmd-diff $((cmd * 2)) \
+	diff/viv-cmd-diff "$DIR/cmd-1.bin" "$DIR/cmd-2.bin"
+run viv-reg-timeline $cmd \
+	diff/viv-reg-timeline -o "$DIR/timeline.bin" "$DIR/cmd-1.bin"
+rm -rf "$DIR/unpack" "$DIR/rt"
+mkdir "$DIR/unpack" "$DIR/rt"
+run viv-unpack $dump dump/viv-unpack "$DIR/dump.bin" "$DIR/unpack"
+run viv-extract-rt $dump \
+	dump/viv-extract-rt -f raw -o "$DIR/rt" "$DIR/dump.bin" 2> /dev/null
+run viv-demultitile $surface \
+	detile/viv-demultitile -w $W -h $H -f raw "$DIR/surface-1.bin"
+run viv-tilecmp $((surface * 2)) \
+	detile/viv-tilecmp -w $W -h $H -t 255 -q "$DIR/surface-1.bin" \
+	"$DIR/surface-2.bin"
+run viv-texdec $surface \
+	detile/viv-texdec -c dxt1 -w $((W * 2)) -f raw "$DIR/surface-1.bin"
+
+bench/viv-bench-parse -r 1 "$DIR/cmd-1.bin"
+
+export LD_PRELOAD="$PWD/mock/libetnaviv-mock.so"
+bench/viv-bench-submit -n 2000
+bench/viv-bench-bo -n 100 -s 4k,1M -m cached,wc
+bench/viv-fence-trace -n 200
@@ -0,0 +1,224 @@
+/*
+ * Common code of the benchmarks: timing, and reporting latency
+ * percentiles as text or as a JSON object for CI.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "etnaviv_drm.h"
+#include "bench.h"
+#include "hdr.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+/* In permille */
+static const struct {
+	unsigned int permille;
+	const char *name;
+	const char *key;
+} percentiles[] = {
+	{ 500, "p50", "p50" },
+	{ 900, "p90", "p90" },
+	{ 990, "p99", "p99" },
+	{ 999, "p99.9", "p99_9" },
+	{ 1000, "max", "max" },
+};
+static int header_done;
+
+uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* An absolute timeout @ns from now, as the etnaviv ioctls take it */
+void bench_timeout(struct drm_etnaviv_timespec *ts, uint64_t ns)
+{
+	uint64_t t = bench_now() + ns;
+
+	ts->tv_sec = t / 1000000000ull;
+	ts->tv_nsec = t % 1000000000ull;
+}
+
+int bench_format(const char *name)
+{
+	if (!strcmp(name, "text"))
+		return BENCH_TEXT;
+	if (!strcmp(name, "json"))
+		return BENCH_JSON;
+	return -1;
+}
+
+int samples_add(struct samples *s, uint64_t ns)
+{
+	if (s->nr == s->max) {
+		size_t max = s->max ? 2 * s->max : 1024;
+		uint64_t *p = realloc(s->ns, max * sizeof(*p));
+
+		if (!p)
+			return -1;
+		s->ns = p;
+		s->max = max;
+	}
+	s->ns[s->nr++] = ns;
+
+	return 0;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	const uint64_t *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+/* Nearest-rank percentile; sorts the samples */
+uint64_t samples_percentile(struct samples *s, unsigned int permille)
+{
+	size_t rank;
+
+	if (!s->nr)
+		return 0;
+
+	qsort(s->ns, s->nr, sizeof(*s->ns), cmp_u64);
+	rank = ((size_t)permille * s->nr + 999) / 1000;
+
+	return s->ns[rank ? rank - 1 : 0];
+}
+
+void samples_free(struct samples *s)
+{
+	free(s->ns);
+	s->ns = NULL;
+	s->nr = s->max = 0;
+}
+
+void bench_report_start(enum bench_format format, const char *name)
+{
+	if (format == BENCH_JSON)
+		printf("{\n\t\"benchmark\": \"%s\"", name);
+	else
+		printf("%s:\n", name);
+	header_done = 0;
+}
+
+void bench_report_value(enum bench_format format, const char *key,
+	const char *fmt, double value)
+{
+	if (format == BENCH_JSON) {
+		printf(",\n\t\"%s\": ", key);
+		printf(fmt, value);
+	} else {
+		printf("  %-24s ", key);
+		printf(fmt, value);
+		printf("\n");
+	}
+}
+
+void bench_report_string(enum bench_format format, const char *key,
+	const char *value)
+{
+	if (format == BENCH_JSON)
+		printf(",\n\t\"%s\": \"%s\"", key, value);
+	else
+		printf("  %-24s %s\n", key, value);
+}
+
+static void report_row(enum bench_format format, const char *key,
+	uint64_t count, const uint64_t *ns)
+{
+	unsigned int i;
+
+	if (format == BENCH_JSON) {
+		printf(",\n\t\"%s\": { \"count\": %llu", key,
+		       (unsigned long long)count);
+		for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+			printf(", \"%s_us\": %.3f", percentiles[i].key,
+			       ns[i] / 1e3);
+		printf(" }");
+	} else {
+		if (!header_done) {
+			printf("  %-24s %8s", "latency (us)", "count");
+			for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+				printf(" %10s", percentiles[i].name);
+			printf("\n");
+			header_done = 1;
+		}
+		printf("  %-24s %8llu", key, (unsigned long long)count);
+		for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+			printf(" %10.1f", ns[i] / 1e3);
+		printf("\n");
+	}
+}
+
+void bench_report_samples(enum bench_format format, const char *key,
+	struct samples *s)
+{
+	uint64_t ns[ARRAY_SIZE(percentiles)];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+		ns[i] = samples_percentile(s, percentiles[i].permille);
+	report_row(format, key, s->nr, ns);
+}
+
+void bench_report_hdr(enum bench_format format, const char *key,
+	const struct hdr_hist *h)
+{
+	uint64_t ns[ARRAY_SIZE(percentiles)];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(percentiles); i++)
+		ns[i] = hdr_percentile(h, percentiles[i].permille);
+	report_row(format, key, h->total, ns);
+}
+
+/*
+ * Histogram of the samples in power of two buckets, bucket n holding
+ * latencies of [2^n, 2^(n+1)) ns.
+ */
+void bench_report_histogram(enum bench_format format, const char *key,
+	const struct samples *s)
+{
+	size_t count[64] = { 0 }, max = 0, i;
+	unsigned int lo = 63, hi = 0, b;
+
+	for (i = 0; i < s->nr; i++) {
+		b = s->ns[i] ? 63 - __builtin_clzll(s->ns[i]) : 0;
+		count[b]++;
+		if (b < lo)
+			lo = b;
+		if (b > hi)
+			hi = b;
+	}
+	for (b = lo; b <= hi; b++)
+		if (count[b] > max)
+			max = count[b];
+
+	if (format == BENCH_JSON) {
+		printf(",\n\t\"%s_histogram\": [", key);
+		for (b = lo; s->nr && b <= hi; b++)
+			printf("%s{ \"ge_ns\": %llu, \"count\": %zu }",
+			       b > lo ? ", " : "", 1ull << b, count[b]);
+		printf("]");
+		return;
+	}
+
+	printf("  %s (us)\n", key);
+	for (b = lo; s->nr && b <= hi; b++)
+		printf("    %10.3f - %-10.3f %-40.*s %zu\n",
+		       (1ull << b) / 1e3, (2ull << b) / 1e3,
+		       (int)(count[b] * 40 / max),
+		       "########################################", count[b]);
+}
+
+void bench_report_end(enum bench_format format)
+{
+	if (format == BENCH_JSON)
+		printf("\n}\n");
+	header_done = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct drm_etnaviv_timespec;
+struct hdr_hist;
+
+/* Latency samples, in ns */
+struct samples {
+	uint64_t *ns;
+	size_t nr, max;
+};
+
+enum bench_format {
+	BENCH_TEXT,
+	BENCH_JSON,
+};
+
+uint64_t bench_now(void);
+void bench_timeout(struct drm_etnaviv_timespec *ts, uint64_t ns);
+int bench_format(const char *name);
+
+int samples_add(struct samples *s, uint64_t ns);
+uint64_t samples_percentile(struct samples *s, unsigned int permille);
+void samples_free(struct samples *s);
+
+void bench_report_start(enum bench_format format, const char *name);
+void bench_report_value(enum bench_format format, const char *key,
+	const char *fmt, double value);
+void bench_report_string(enum bench_format format, const char *key,
+	const char *value);
+void bench_report_samples(enum bench_format format, const char *key,
+	struct samples *s);
+void bench_report_hdr(enum bench_format format, const char *key,
+	const struct hdr_hist *h);
+void bench_report_histogram(enum bench_format format, const char *key,
+	const struct samples *s);
+void bench_report_end(enum bench_format format);
+
+#endif
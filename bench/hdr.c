@@ -0,0 +1,46 @@
+#include "hdr.h"
+
+/*
+ * Values below HDR_SUB_BUCKETS are counted exactly in magnitude 0.
+ * Larger values are shifted right by their magnitude m until they fit
+ * the upper half of the sub-buckets, so each bucket of magnitude m is
+ * 2^m wide.
+ */
+void hdr_add(struct hdr_hist *h, uint64_t ns)
+{
+	unsigned int m = 0;
+
+	if (ns >= HDR_SUB_BUCKETS)
+		m = 64 - __builtin_clzll(ns) - HDR_SUB_BITS;
+
+	h->counts[m][ns >> m]++;
+	h->total++;
+	if (ns > h->max)
+		h->max = ns;
+}
+
+/* The highest value equivalent to the permille'th value's bucket */
+uint64_t hdr_percentile(const struct hdr_hist *h, unsigned int permille)
+{
+	uint64_t rank, seen = 0, v;
+	unsigned int m, s;
+
+	if (!h->total)
+		return 0;
+
+	rank = (h->total * permille + 999) / 1000;
+	if (!rank)
+		rank = 1;
+
+	for (m = 0; m < HDR_MAGNITUDES; m++) {
+		for (s = m ? HDR_SUB_BUCKETS / 2 : 0; s < HDR_SUB_BUCKETS; s++) {
+			seen += h->counts[m][s];
+			if (seen < rank)
+				continue;
+			v = ((uint64_t)(s + 1) << m) - 1;
+			return v < h->max ? v : h->max;
+		}
+	}
+
+	return h->max;
+}
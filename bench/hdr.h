@@ -0,0 +1,24 @@
+#ifndef HDR_H
+#define HDR_H
+
+#include <stdint.h>
+
+/*
+ * High dynamic range histogram of ns latencies: every value from 1ns to
+ * hours is kept to HDR_SUB_BITS - 1 significant bits, under 2% error,
+ * in fixed memory and constant time per value.
+ */
+#define HDR_SUB_BITS	7
+#define HDR_SUB_BUCKETS	(1 << HDR_SUB_BITS)
+#define HDR_MAGNITUDES	(64 - HDR_SUB_BITS + 1)
+
+struct hdr_hist {
+	uint64_t counts[HDR_MAGNITUDES][HDR_SUB_BUCKETS];
+	uint64_t total;
+	uint64_t max;
+};
+
+void hdr_add(struct hdr_hist *h, uint64_t ns);
+uint64_t hdr_percentile(const struct hdr_hist *h, unsigned int permille);
+
+#endif
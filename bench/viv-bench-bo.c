@@ -0,0 +1,397 @@
+/*
+ * Buffer object churn: allocation, mapping, first touch and CPU access
+ * latencies.
+ *
+ * For every thread count, BO mode and size given, each thread does COUNT
+ * rounds of
+ *
+ *   GEM_NEW (or GEM_USERPTR on page aligned malloc memory), GEM_INFO,
+ *   mmap, a write to every page, CPU_PREP and CPU_FINI for read/write,
+ *   munmap and GEM_CLOSE
+ *
+ * on the one shared render node fd, timing each step.  Userptr BOs are
+ * not mapped through the device, so they skip GEM_INFO to munmap but for
+ * the CPU_PREP/FINI pair.  Each configuration is reported with latency
+ * percentiles and a histogram per operation.
+ */
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include "etnaviv_drm.h"
+#include "../info/render.h"
+#include "bench.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#define MAX_LIST	16
+
+enum {
+	OP_NEW,
+	OP_USERPTR,
+	OP_INFO,
+	OP_MMAP,
+	OP_TOUCH,
+	OP_PREP,
+	OP_FINI,
+	OP_MUNMAP,
+	OP_CLOSE,
+	NR_OPS,
+};
+
+static const char *const op_names[NR_OPS] = {
+	[OP_NEW] = "gem_new",
+	[OP_USERPTR] = "gem_userptr",
+	[OP_INFO] = "gem_info",
+	[OP_MMAP] = "mmap",
+	[OP_TOUCH] = "first_touch",
+	[OP_PREP] = "cpu_prep",
+	[OP_FINI] = "cpu_fini",
+	[OP_MUNMAP] = "munmap",
+	[OP_CLOSE] = "gem_close",
+};
+
+static const struct {
+	const char *name;
+	uint32_t flags;		/* of GEM_NEW, 0 for userptr */
+} modes[] = {
+	{ "cached", ETNA_BO_CACHED },
+	{ "wc", ETNA_BO_WC },
+	{ "uncached", ETNA_BO_UNCACHED },
+	{ "userptr", 0 },
+};
+
+struct bo_bench {
+	int fd;
+	uint32_t flags;
+	size_t size;
+	unsigned int count;
+	pthread_barrier_t start;
+};
+
+struct bo_thread {
+	pthread_t thread;
+	struct bo_bench *b;
+	struct samples ns[NR_OPS];
+};
+
+static size_t page_size;
+
+static void add(struct bo_thread *t, unsigned int op, uint64_t start)
+{
+	if (samples_add(&t->ns[op], bench_now() - start))
+		error(1, ENOMEM, "samples");
+}
+
+static void ioctl_or_die(int fd, unsigned long nr, void *req,
+	unsigned long size, unsigned int op)
+{
+	int ret = drmCommandWriteRead(fd, nr, req, size);
+
+	if (ret)
+		error(1, -ret, "%s", op_names[op]);
+}
+
+static uint32_t gem_new(struct bo_thread *t)
+{
+	struct drm_etnaviv_gem_new req = {
+		.size = t->b->size,
+		.flags = t->b->flags,
+	};
+	uint64_t t0 = bench_now();
+
+	ioctl_or_die(t->b->fd, DRM_ETNAVIV_GEM_NEW, &req, sizeof(req), OP_NEW);
+	add(t, OP_NEW, t0);
+
+	return req.handle;
+}
+
+static uint32_t gem_userptr(struct bo_thread *t, void *ptr)
+{
+	struct drm_etnaviv_gem_userptr req = {
+		.user_ptr = (uintptr_t)ptr,
+		.user_size = t->b->size,
+		.flags = ETNA_USERPTR_READ | ETNA_USERPTR_WRITE,
+	};
+	uint64_t t0 = bench_now();
+
+	ioctl_or_die(t->b->fd, DRM_ETNAVIV_GEM_USERPTR, &req, sizeof(req),
+		     OP_USERPTR);
+	add(t, OP_USERPTR, t0);
+
+	return req.handle;
+}
+
+static void *map_bo(struct bo_thread *t, uint32_t handle)
+{
+	struct drm_etnaviv_gem_info req = { .handle = handle };
+	uint64_t t0 = bench_now();
+	void *ptr;
+
+	ioctl_or_die(t->b->fd, DRM_ETNAVIV_GEM_INFO, &req, sizeof(req), OP_INFO);
+	add(t, OP_INFO, t0);
+
+	t0 = bench_now();
+	ptr = mmap(NULL, t->b->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   t->b->fd, req.offset);
+	if (ptr == MAP_FAILED)
+		error(1, errno, "mmap");
+	add(t, OP_MMAP, t0);
+
+	return ptr;
+}
+
+static void touch(struct bo_thread *t, volatile uint8_t *ptr)
+{
+	uint64_t t0 = bench_now();
+	size_t i;
+
+	for (i = 0; i < t->b->size; i += page_size)
+		ptr[i] = i;
+	add(t, OP_TOUCH, t0);
+}
+
+static void cpu_access(struct bo_thread *t, uint32_t handle)
+{
+	struct drm_etnaviv_gem_cpu_prep prep = {
+		.handle = handle,
+		.op = ETNA_PREP_READ | ETNA_PREP_WRITE,
+	};
+	struct drm_etnaviv_gem_cpu_fini fini = { .handle = handle };
+	uint64_t t0;
+
+	bench_timeout(&prep.timeout, 1000000000ull);
+	t0 = bench_now();
+	ioctl_or_die(t->b->fd, DRM_ETNAVIV_GEM_CPU_PREP, &prep, sizeof(prep),
+		     OP_PREP);
+	add(t, OP_PREP, t0);
+
+	t0 = bench_now();
+	ioctl_or_die(t->b->fd, DRM_ETNAVIV_GEM_CPU_FINI, &fini, sizeof(fini),
+		     OP_FINI);
+	add(t, OP_FINI, t0);
+}
+
+static void gem_close(struct bo_thread *t, uint32_t handle)
+{
+	struct drm_gem_close req = { .handle = handle };
+	uint64_t t0 = bench_now();
+
+	if (drmIoctl(t->b->fd, DRM_IOCTL_GEM_CLOSE, &req))
+		error(1, errno, "%s", op_names[OP_CLOSE]);
+	add(t, OP_CLOSE, t0);
+}
+
+static void *bo_thread(void *arg)
+{
+	struct bo_thread *t = arg;
+	struct bo_bench *b = t->b;
+	unsigned int i;
+	uint32_t handle;
+	uint64_t t0;
+	void *ptr;
+
+	pthread_barrier_wait(&b->start);
+
+	for (i = 0; i < b->count; i++) {
+		if (!b->flags) {
+			ptr = aligned_alloc(page_size, b->size);
+			if (!ptr)
+				error(1, ENOMEM, "userptr memory");
+			handle = gem_userptr(t, ptr);
+			cpu_access(t, handle);
+			gem_close(t, handle);
+			free(ptr);
+			continue;
+		}
+
+		handle = gem_new(t);
+		ptr = map_bo(t, handle);
+		touch(t, ptr);
+		cpu_access(t, handle);
+
+		t0 = bench_now();
+		munmap(ptr, b->size);
+		add(t, OP_MUNMAP, t0);
+
+		gem_close(t, handle);
+	}
+
+	return NULL;
+}
+
+static void run(struct bo_bench *b, unsigned int nr_threads,
+	const char *mode, enum bench_format format)
+{
+	struct bo_thread *t;
+	struct samples total[NR_OPS];
+	unsigned int i, op;
+	uint64_t t0, elapsed;
+	int ret;
+
+	t = calloc(nr_threads, sizeof(*t));
+	if (!t)
+		error(1, ENOMEM, "threads");
+	memset(total, 0, sizeof(total));
+	pthread_barrier_init(&b->start, NULL, nr_threads + 1);
+
+	for (i = 0; i < nr_threads; i++) {
+		t[i].b = b;
+		ret = pthread_create(&t[i].thread, NULL, bo_thread, &t[i]);
+		if (ret)
+			error(1, ret, "pthread_create");
+	}
+	t0 = bench_now();
+	pthread_barrier_wait(&b->start);
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(t[i].thread, NULL);
+	elapsed = bench_now() - t0;
+	pthread_barrier_destroy(&b->start);
+
+	for (i = 0; i < nr_threads; i++) {
+		for (op = 0; op < NR_OPS; op++) {
+			size_t n;
+
+			for (n = 0; n < t[i].ns[op].nr; n++)
+				if (samples_add(&total[op], t[i].ns[op].ns[n]))
+					error(1, ENOMEM, "samples");
+			samples_free(&t[i].ns[op]);
+		}
+	}
+	free(t);
+
+	bench_report_start(format, "bo");
+	bench_report_value(format, "threads", "%.0f", nr_threads);
+	bench_report_string(format, "mode", mode);
+	bench_report_value(format, "bytes", "%.0f", b->size);
+	bench_report_value(format, "rounds", "%.0f", b->count * nr_threads);
+	bench_report_value(format, "rounds_per_sec", "%.1f",
+			   b->count * nr_threads / (elapsed / 1e9));
+	for (op = 0; op < NR_OPS; op++)
+		if (total[op].nr)
+			bench_report_samples(format, op_names[op], &total[op]);
+	for (op = 0; op < NR_OPS; op++)
+		if (total[op].nr)
+			bench_report_histogram(format, op_names[op], &total[op]);
+	bench_report_end(format);
+
+	for (op = 0; op < NR_OPS; op++)
+		samples_free(&total[op]);
+}
+
+/* A comma separated list of numbers, with an optional k or M suffix */
+static unsigned int parse_list(const char *arg, unsigned long *vals)
+{
+	unsigned int n = 0;
+	char *end;
+
+	do {
+		if (n == MAX_LIST)
+			return 0;
+		vals[n] = strtoul(arg, &end, 0);
+		if (*end == 'k')
+			vals[n] <<= 10, end++;
+		else if (*end == 'M')
+			vals[n] <<= 20, end++;
+		if (end == arg || !vals[n] || (*end && *end != ','))
+			return 0;
+		n++;
+		arg = end + 1;
+	} while (*end);
+
+	return n;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-d DEVICE] [-s SIZE,...] [-t THREADS,...] [-m MODE,...] [-n COUNT]\n"
+		"       [-f text|json]\n"
+		"MODE is cached, wc, uncached or userptr\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long sizes[MAX_LIST] = { 4096, 65536, 1 << 20 };
+	unsigned long threads[MAX_LIST] = { 1 };
+	unsigned int nr_sizes = 3, nr_threads = 1, mode_mask = 0;
+	unsigned int i, j, m;
+	struct bo_bench b = { .count = 100 };
+	const char *device = NULL;
+	int opt, format = BENCH_TEXT;
+	char *tok, *save;
+
+	page_size = sysconf(_SC_PAGESIZE);
+
+	while ((opt = getopt(argc, argv, "d:s:t:m:n:f:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 's':
+			nr_sizes = parse_list(optarg, sizes);
+			if (!nr_sizes)
+				usage(argv[0]);
+			break;
+		case 't':
+			nr_threads = parse_list(optarg, threads);
+			if (!nr_threads)
+				usage(argv[0]);
+			break;
+		case 'm':
+			for (tok = strtok_r(optarg, ",", &save); tok;
+			     tok = strtok_r(NULL, ",", &save)) {
+				for (m = 0; m < ARRAY_SIZE(modes); m++)
+					if (!strcmp(tok, modes[m].name))
+						break;
+				if (m == ARRAY_SIZE(modes))
+					usage(argv[0]);
+				mode_mask |= 1 << m;
+			}
+			break;
+		case 'n':
+			b.count = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			format = bench_format(optarg);
+			if (format < 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc || !b.count)
+		usage(argv[0]);
+	if (!mode_mask)
+		mode_mask = (1 << (ARRAY_SIZE(modes))) - 1;
+
+	b.fd = render_open(device, NULL, 0);
+	if (b.fd == -1)
+		error(1, errno, "%s", device ? device : "etnaviv render node");
+
+	for (i = 0; i < nr_threads; i++) {
+		for (m = 0; m < ARRAY_SIZE(modes); m++) {
+			if (!(mode_mask & (1 << m)))
+				continue;
+			for (j = 0; j < nr_sizes; j++) {
+				/* GEM_NEW rounds up, userptr needs whole pages */
+				b.size = (sizes[j] + page_size - 1) & ~(page_size - 1);
+				b.flags = modes[m].flags;
+				run(&b, threads[i], modes[m].name, format);
+			}
+		}
+	}
+
+	close(b.fd);
+
+	return 0;
+}
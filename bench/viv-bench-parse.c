@@ -0,0 +1,265 @@
+/*
+ * Command stream parsing throughput of libvivcmd.
+ *
+ * A synthetic stream of SIZE bytes is built in memory by repeating a
+ * block of draws, each a run of LOAD_STATEs of mostly a few states and
+ * now and then a shader-sized upload, with the odd NOP and STALL.  A
+ * FILE is parsed as it is instead.  The stream is then parsed REPEAT
+ * times with each of:
+ *   walk	an op callback only, the cost of decoding commands
+ *   state	a state callback reading every state value
+ *   replay	read_state() to each draw, as viv-cmd-diff does
+ * and the best time of each is reported.
+ */
+#include <errno.h>
+#include <error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../cmd/vivcmd.h"
+#include "../diff/state.h"
+#include "bench.h"
+
+#define BLOCK_WORDS	(64 * 1024)
+
+struct parse_stats {
+	uint64_t ops;
+	uint64_t states;
+	uint64_t draws;
+	uint32_t sum;
+};
+
+static uint32_t xorshift(uint32_t *x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+	return *x;
+}
+
+/* A block of whole commands, returning its length in words */
+static size_t build_block(uint32_t *buf, size_t max)
+{
+	static const uint16_t regs[] = {
+		0x0600, 0x0680, 0x0800, 0x1028, 0x1400, 0x1410, 0x1430,
+		0x14a0, 0x1600, 0x3800,
+	};
+	uint32_t x = 0x1234567;
+	size_t n = 0;
+	unsigned int num, i;
+
+	while (n + 1026 + 6 + 4 <= max) {
+		do {
+			if (xorshift(&x) % 64 == 0)
+				num = 64 + xorshift(&x) % 192;
+			else
+				num = 1 + xorshift(&x) % 4;
+			buf[n++] = 1 << 27 | num << 16 |
+				   regs[xorshift(&x) % 10] >> 2;
+			for (i = 0; i < num; i++)
+				buf[n++] = xorshift(&x);
+			if (n % 2)
+				buf[n++] = 0;
+		} while (xorshift(&x) % 8 && n + 258 + 10 <= max);
+
+		if (xorshift(&x) % 16 == 0) {
+			buf[n++] = VIVCMD_NOP << 27;
+			buf[n++] = 0;
+		}
+		if (xorshift(&x) % 32 == 0) {
+			buf[n++] = VIVCMD_STALL << 27;
+			buf[n++] = 0x701;
+		}
+
+		if (x % 2) {
+			buf[n++] = VIVCMD_DRAW_PRIMITIVES << 27;
+			buf[n++] = 4;
+			buf[n++] = 0;
+			buf[n++] = xorshift(&x) % 1024;
+		} else {
+			buf[n++] = VIVCMD_DRAW_INDEXED_PRIMITIVES << 27;
+			buf[n++] = 4;
+			buf[n++] = 0;
+			buf[n++] = xorshift(&x) % 1024;
+			buf[n++] = 0;
+			buf[n++] = 0;
+		}
+	}
+
+	return n;
+}
+
+static void build_stream(struct vivcmd_stream *s, size_t bytes)
+{
+	uint32_t *buf;
+	size_t block, pos;
+
+	buf = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (buf == MAP_FAILED)
+		error(1, errno, "stream of %zu bytes", bytes);
+
+	block = build_block(buf, BLOCK_WORDS);
+	for (pos = block; pos + block <= bytes / 4; pos += block)
+		memcpy(buf + pos, buf, block * 4);
+
+	s->buf = buf;
+	s->size = pos;
+	s->pos = 0;
+}
+
+static int walk_op(void *priv, const struct vivcmd_op *op)
+{
+	struct parse_stats *st = priv;
+
+	st->ops++;
+	return 0;
+}
+
+static int walk_state(void *priv, uint32_t addr, const uint32_t *values,
+	unsigned int num)
+{
+	struct parse_stats *st = priv;
+	uint32_t sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		sum += values[i];
+	st->sum += sum;
+	st->states += num;
+	return 0;
+}
+
+static int walk_draw(void *priv, const struct vivcmd_op *op)
+{
+	struct parse_stats *st = priv;
+
+	st->draws++;
+	return 0;
+}
+
+static const struct vivcmd_visitor walk_visitor = {
+	.op = walk_op,
+};
+
+static const struct vivcmd_visitor state_visitor = {
+	.state = walk_state,
+	.draw = walk_draw,
+};
+
+static uint64_t run(const char *pass, struct vivcmd_stream *s,
+	struct parse_stats *st)
+{
+	static struct state state;
+	uint64_t t0;
+	int ret;
+
+	memset(st, 0, sizeof(*st));
+	s->pos = 0;
+	t0 = bench_now();
+
+	if (!strcmp(pass, "walk"))
+		ret = vivcmd_parse(s, &walk_visitor, st);
+	else if (!strcmp(pass, "state"))
+		ret = vivcmd_parse(s, &state_visitor, st);
+	else
+		while ((ret = read_state(s, &state)) == 1)
+			st->draws++;
+
+	if (ret)
+		error(1, errno, "%s: offset 0x%llx", pass,
+		      (unsigned long long)s->pos * 4);
+
+	return bench_now() - t0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-s SIZE] [-r REPEAT] [-f text|json] [FILE]\n"
+		"SIZE may have a k, M or G suffix\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	static const char *const passes[] = { "walk", "state", "replay" };
+	unsigned long long size = 2ull << 30;
+	unsigned int repeat = 3, p, i;
+	struct vivcmd_stream s;
+	struct parse_stats st;
+	int opt, format = BENCH_TEXT;
+	uint64_t ns, best;
+	char key[32], *end;
+
+	while ((opt = getopt(argc, argv, "s:r:f:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = strtoull(optarg, &end, 0);
+			if (*end == 'k')
+				size <<= 10, end++;
+			else if (*end == 'M')
+				size <<= 20, end++;
+			else if (*end == 'G')
+				size <<= 30, end++;
+			if (*end || size < BLOCK_WORDS * 4)
+				usage(argv[0]);
+			break;
+		case 'r':
+			repeat = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			format = bench_format(optarg);
+			if (format < 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind < argc - 1 || !repeat)
+		usage(argv[0]);
+
+	if (optind < argc) {
+		if (vivcmd_stream_open(&s, argv[optind]))
+			error(1, errno, "%s", argv[optind]);
+	} else {
+		build_stream(&s, size);
+	}
+
+	bench_report_start(format, "parse");
+	bench_report_value(format, "bytes", "%.0f", s.size * 4.0);
+
+	for (p = 0; p < sizeof(passes) / sizeof(passes[0]); p++) {
+		best = UINT64_MAX;
+		for (i = 0; i < repeat; i++) {
+			ns = run(passes[p], &s, &st);
+			if (ns < best)
+				best = ns;
+		}
+
+		if (p == 0) {
+			bench_report_value(format, "commands", "%.0f", st.ops);
+		} else if (p == 1) {
+			bench_report_value(format, "states", "%.0f", st.states);
+			bench_report_value(format, "draws", "%.0f", st.draws);
+		}
+		snprintf(key, sizeof(key), "%s_seconds", passes[p]);
+		bench_report_value(format, key, "%.6f", best / 1e9);
+		snprintf(key, sizeof(key), "%s_gb_per_sec", passes[p]);
+		bench_report_value(format, key, "%.3f", s.size * 4.0 / best);
+	}
+	bench_report_end(format);
+
+	if (optind < argc)
+		vivcmd_stream_close(&s);
+	else
+		munmap((void *)s.buf, size);
+
+	return 0;
+}
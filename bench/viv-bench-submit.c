@@ -0,0 +1,261 @@
+/*
+ * GEM_SUBMIT throughput and latency.
+ *
+ * A command stream of SIZE bytes is built once: RELOCS load states of
+ * PE_COLOR_ADDR, each relocated to one of BOS buffer objects in turn,
+ * padded out with NOPs.  It is submitted COUNT times in a tight loop,
+ * keeping up to DEPTH submits in flight: before each submit beyond that
+ * the oldest fence is waited for with WAIT_FENCE.  A depth of 1 waits
+ * for every submit before the next.
+ *
+ * Reported are submits per second, the time spent in the submit ioctl,
+ * and the time from each submit to seeing its fence signalled.  A few
+ * submits are made first and not counted, to fault everything in.
+ *
+ * Run under the mock device (mock/libetnaviv-mock.so) for a driver-free
+ * baseline.
+ */
+#include <errno.h>
+#include <error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include "etnaviv_drm.h"
+#include "hw/state_3d.xml.h"
+#include "../info/render.h"
+#include "bench.h"
+
+#define WARMUP		16
+#define FENCE_TIMEOUT	(10 * 1000000000ull)
+
+/* Command stream words, as the FE decodes them */
+#define CMD_LOAD_STATE(reg, num)	(1 << 27 | (num) << 16 | (reg) >> 2)
+#define CMD_NOP				(3 << 27)
+
+struct submit_bench {
+	int fd;
+	unsigned int pipe;
+	unsigned int depth;
+	struct drm_etnaviv_gem_submit_bo *bos;
+	struct drm_etnaviv_gem_submit_reloc *relocs;
+	uint32_t *stream;
+	struct drm_etnaviv_gem_submit req;
+};
+
+static void create_bos(struct submit_bench *b, unsigned int nr_bos,
+	unsigned int bo_size)
+{
+	unsigned int i;
+
+	b->bos = calloc(nr_bos, sizeof(*b->bos));
+	if (!b->bos)
+		error(1, ENOMEM, "bos");
+
+	for (i = 0; i < nr_bos; i++) {
+		struct drm_etnaviv_gem_new req = {
+			.size = bo_size,
+			.flags = ETNA_BO_WC,
+		};
+		int ret;
+
+		ret = drmCommandWriteRead(b->fd, DRM_ETNAVIV_GEM_NEW, &req,
+					  sizeof(req));
+		if (ret)
+			error(1, -ret, "GEM_NEW");
+
+		b->bos[i].handle = req.handle;
+		b->bos[i].flags = ETNA_SUBMIT_BO_READ;
+	}
+}
+
+static void build_stream(struct submit_bench *b, unsigned int size,
+	unsigned int nr_relocs, unsigned int nr_bos)
+{
+	unsigned int i, words = size / 4;
+
+	b->stream = malloc(size);
+	b->relocs = calloc(nr_relocs ? nr_relocs : 1, sizeof(*b->relocs));
+	if (!b->stream || !b->relocs)
+		error(1, ENOMEM, "stream");
+
+	for (i = 0; i < words; i += 2) {
+		if (i / 2 < nr_relocs) {
+			struct drm_etnaviv_gem_submit_reloc *r =
+				&b->relocs[i / 2];
+
+			b->stream[i] = CMD_LOAD_STATE(VIVS_PE_COLOR_ADDR, 1);
+			b->stream[i + 1] = 0;
+			r->submit_offset = (i + 1) * 4;
+			r->reloc_idx = i / 2 % nr_bos;
+			r->reloc_offset = 0;
+		} else {
+			b->stream[i] = CMD_NOP;
+			b->stream[i + 1] = 0;
+		}
+	}
+
+	b->req.exec_state = ETNA_PIPE_3D;
+	b->req.nr_bos = nr_bos;
+	b->req.nr_relocs = nr_relocs;
+	b->req.stream_size = size;
+	b->req.bos = (uintptr_t)b->bos;
+	b->req.relocs = (uintptr_t)b->relocs;
+	b->req.stream = (uintptr_t)b->stream;
+}
+
+static uint32_t submit(struct submit_bench *b)
+{
+	int ret;
+
+	b->req.pipe = b->pipe;
+	ret = drmCommandWriteRead(b->fd, DRM_ETNAVIV_GEM_SUBMIT, &b->req,
+				  sizeof(b->req));
+	if (ret)
+		error(1, -ret, "GEM_SUBMIT");
+
+	return b->req.fence;
+}
+
+static void wait_fence(struct submit_bench *b, uint32_t fence)
+{
+	struct drm_etnaviv_wait_fence req = {
+		.pipe = b->pipe,
+		.fence = fence,
+	};
+	int ret;
+
+	bench_timeout(&req.timeout, FENCE_TIMEOUT);
+	ret = drmCommandWriteRead(b->fd, DRM_ETNAVIV_WAIT_FENCE, &req,
+				  sizeof(req));
+	if (ret)
+		error(1, -ret, "WAIT_FENCE %u", fence);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-d DEVICE] [-p PIPE] [-b BOS] [-z BO_SIZE] [-r RELOCS] [-s SIZE]\n"
+		"       [-n COUNT] [-q DEPTH] [-f text|json]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int nr_bos = 4, bo_size = 4096, nr_relocs = 16, size = 4096;
+	unsigned int count = 10000, i;
+	struct samples submit_ns = { 0 }, fence_ns = { 0 };
+	struct submit_bench b = { .depth = 1 };
+	const char *device = NULL;
+	int opt, format = BENCH_TEXT;
+	uint32_t *fences;
+	uint64_t *start, t0, t1, elapsed;
+
+	while ((opt = getopt(argc, argv, "d:p:b:z:r:s:n:q:f:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'p':
+			b.pipe = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			nr_bos = strtoul(optarg, NULL, 0);
+			break;
+		case 'z':
+			bo_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nr_relocs = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			size = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'q':
+			b.depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			format = bench_format(optarg);
+			if (format < 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc || !nr_bos || !bo_size || !count || !b.depth ||
+	    size < 8 || size % 8)
+		usage(argv[0]);
+	if (nr_relocs > size / 8)
+		error(1, 0, "%u relocs need a stream of at least %u bytes",
+		      nr_relocs, nr_relocs * 8);
+
+	b.fd = render_open(device, NULL, 0);
+	if (b.fd == -1)
+		error(1, errno, "%s", device ? device : "etnaviv render node");
+
+	create_bos(&b, nr_bos, bo_size);
+	build_stream(&b, size, nr_relocs, nr_bos);
+
+	for (i = 0; i < WARMUP; i++)
+		wait_fence(&b, submit(&b));
+
+	fences = calloc(count, sizeof(*fences));
+	start = calloc(count, sizeof(*start));
+	if (!fences || !start)
+		error(1, ENOMEM, "fences");
+
+	t0 = bench_now();
+	for (i = 0; i < count; i++) {
+		if (i >= b.depth) {
+			wait_fence(&b, fences[i - b.depth]);
+			t1 = bench_now();
+			if (samples_add(&fence_ns, t1 - start[i - b.depth]))
+				error(1, ENOMEM, "samples");
+		}
+
+		start[i] = bench_now();
+		fences[i] = submit(&b);
+		t1 = bench_now();
+		if (samples_add(&submit_ns, t1 - start[i]))
+			error(1, ENOMEM, "samples");
+	}
+	for (i = count > b.depth ? count - b.depth : 0; i < count; i++) {
+		wait_fence(&b, fences[i]);
+		t1 = bench_now();
+		if (samples_add(&fence_ns, t1 - start[i]))
+			error(1, ENOMEM, "samples");
+	}
+	elapsed = bench_now() - t0;
+
+	bench_report_start(format, "submit");
+	bench_report_value(format, "bos", "%.0f", nr_bos);
+	bench_report_value(format, "relocs", "%.0f", nr_relocs);
+	bench_report_value(format, "stream_bytes", "%.0f", size);
+	bench_report_value(format, "depth", "%.0f", b.depth);
+	bench_report_value(format, "submits", "%.0f", count);
+	bench_report_value(format, "seconds", "%.6f", elapsed / 1e9);
+	bench_report_value(format, "submits_per_sec", "%.1f",
+			   count / (elapsed / 1e9));
+	bench_report_samples(format, "submit_ioctl", &submit_ns);
+	bench_report_samples(format, "submit_to_signal", &fence_ns);
+	bench_report_end(format);
+
+	samples_free(&submit_ns);
+	samples_free(&fence_ns);
+	free(fences);
+	free(start);
+	free(b.stream);
+	free(b.relocs);
+	free(b.bos);
+	close(b.fd);
+
+	return 0;
+}
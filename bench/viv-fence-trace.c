@@ -0,0 +1,381 @@
+/*
+ * Fence wait latency and scheduling jitter.
+ *
+ * On each pipe, COUNT minimal command streams (a single NOP) are
+ * submitted one at a time and waited for twice over: the main thread
+ * blocks in WAIT_FENCE, while a poller thread spins on the same fence
+ * with ETNA_WAIT_NONBLOCK to timestamp when it signalled.  The poller
+ * keeps a CPU busy, so run this on a system with more than one.
+ *
+ * Reported per pipe, as HDR histogram percentiles:
+ *   submit_ioctl	time spent in GEM_SUBMIT
+ *   submit_to_signal	submit until the poller saw the fence signalled
+ *   signal_to_wake	that until the blocking wait returned
+ *   submit_to_wake	submit until the blocking wait returned
+ *   period_jitter	with -i, how late each submit was on its schedule
+ * A blocking wait returning before the poller sees the fence counts as
+ * an early wake, with a signal_to_wake of 0.
+ *
+ * With -o, every submit is also written to TRACE as Chrome trace events
+ * (chrome://tracing, Perfetto): one track per pipe with a "submit",
+ * "gpu" and "wake" slice each.
+ *
+ * Run under the mock device (mock/libetnaviv-mock.so) with
+ * latency_exec_jitter and latency_wake in its profile to test.
+ */
+#include <errno.h>
+#include <error.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include "etnaviv_drm.h"
+#include "hw/common.xml.h"
+#include "../info/render.h"
+#include "bench.h"
+#include "hdr.h"
+
+#define WARMUP		16
+#define FENCE_TIMEOUT	(10 * 1000000000ull)
+
+/* Command stream words, as the FE decodes them */
+#define CMD_NOP		(3 << 27)
+
+struct fence_trace {
+	int fd;
+	unsigned int pipe;
+	uint32_t exec_state;
+	struct drm_etnaviv_gem_submit req;
+
+	/* Handoff to the poller */
+	pthread_t poller;
+	uint32_t poll_fence;	/* fence to poll for, 0 for none */
+	uint32_t seen_fence;	/* last fence seen signalled */
+	uint64_t seen_ns;	/* when it was seen */
+	int quit;
+	int poll_error;
+};
+
+struct pipe_stats {
+	struct hdr_hist submit_ioctl;
+	struct hdr_hist submit_to_signal;
+	struct hdr_hist signal_to_wake;
+	struct hdr_hist submit_to_wake;
+	struct hdr_hist period_jitter;
+	uint64_t early_wakes;
+};
+
+static const char *const pipe_names[] = {
+	[ETNA_PIPE_3D] = "3D",
+	[ETNA_PIPE_2D] = "2D",
+	[ETNA_PIPE_VG] = "VG",
+};
+
+static int get_param(int fd, unsigned int pipe, uint32_t param,
+	uint64_t *value)
+{
+	struct drm_etnaviv_param req = {
+		.pipe = pipe,
+		.param = param,
+	};
+	int ret;
+
+	ret = drmCommandWriteRead(fd, DRM_ETNAVIV_GET_PARAM, &req,
+				  sizeof(req));
+	if (ret)
+		return ret;
+
+	*value = req.value;
+	return 0;
+}
+
+/* The first exec state the core supports, or -1 for no core */
+static int pipe_exec_state(int fd, unsigned int pipe)
+{
+	uint64_t model, features;
+
+	if (get_param(fd, pipe, ETNAVIV_PARAM_GPU_MODEL, &model) ||
+	    get_param(fd, pipe, ETNAVIV_PARAM_GPU_FEATURES_0, &features))
+		return -1;
+
+	if (features & chipFeatures_PIPE_3D)
+		return ETNA_PIPE_3D;
+	if (features & chipFeatures_PIPE_2D)
+		return ETNA_PIPE_2D;
+	if (features & chipFeatures_PIPE_VG)
+		return ETNA_PIPE_VG;
+	return ETNA_PIPE_3D;
+}
+
+static int wait_fence(struct fence_trace *t, uint32_t fence, uint32_t flags)
+{
+	struct drm_etnaviv_wait_fence req = {
+		.pipe = t->pipe,
+		.fence = fence,
+		.flags = flags,
+	};
+
+	bench_timeout(&req.timeout, FENCE_TIMEOUT);
+	return drmCommandWriteRead(t->fd, DRM_ETNAVIV_WAIT_FENCE, &req,
+				   sizeof(req));
+}
+
+static void *poller(void *arg)
+{
+	struct fence_trace *t = arg;
+	uint32_t done = 0, fence;
+	int ret;
+
+	while (!__atomic_load_n(&t->quit, __ATOMIC_ACQUIRE)) {
+		fence = __atomic_load_n(&t->poll_fence, __ATOMIC_ACQUIRE);
+		if (fence == done)
+			continue;
+
+		ret = wait_fence(t, fence, ETNA_WAIT_NONBLOCK);
+		if (ret == -EBUSY)
+			continue;
+		if (ret) {
+			t->poll_error = -ret;
+			__atomic_store_n(&t->quit, 1, __ATOMIC_RELEASE);
+			break;
+		}
+
+		t->seen_ns = bench_now();
+		done = fence;
+		__atomic_store_n(&t->seen_fence, fence, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+static void trace_event(FILE *trace, const char *name, unsigned int pipe,
+	uint64_t start, uint64_t end, uint64_t t0)
+{
+	if (!trace || end < start)
+		return;
+
+	fprintf(trace, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+		"\"ts\":%.3f,\"dur\":%.3f}", name, pipe,
+		(start - t0) / 1e3, (end - start) / 1e3);
+}
+
+static void run_pipe(struct fence_trace *t, struct pipe_stats *st,
+	unsigned int count, uint64_t period, FILE *trace, uint64_t t0)
+{
+	uint64_t next = 0, start, submitted, woken, seen;
+	struct timespec ts;
+	unsigned int i;
+	uint32_t fence;
+	int ret;
+
+	t->poll_fence = t->seen_fence = 0;
+	t->quit = t->poll_error = 0;
+	ret = pthread_create(&t->poller, NULL, poller, t);
+	if (ret)
+		error(1, ret, "pthread_create");
+
+	for (i = 0; i < WARMUP + count; i++) {
+		if (period) {
+			if (i == 0 || i == WARMUP)
+				next = bench_now() + period;
+			else
+				next += period;
+			ts.tv_sec = next / 1000000000ull;
+			ts.tv_nsec = next % 1000000000ull;
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME,
+					       &ts, NULL) == EINTR)
+				;
+		}
+
+		start = bench_now();
+		t->req.pipe = t->pipe;
+		ret = drmCommandWriteRead(t->fd, DRM_ETNAVIV_GEM_SUBMIT,
+					  &t->req, sizeof(t->req));
+		if (ret)
+			error(1, -ret, "GEM_SUBMIT on pipe %u", t->pipe);
+		submitted = bench_now();
+		fence = t->req.fence;
+		__atomic_store_n(&t->poll_fence, fence, __ATOMIC_RELEASE);
+
+		ret = wait_fence(t, fence, 0);
+		if (ret)
+			error(1, -ret, "WAIT_FENCE %u on pipe %u", fence,
+			      t->pipe);
+		woken = bench_now();
+
+		while (__atomic_load_n(&t->seen_fence, __ATOMIC_ACQUIRE) !=
+		       fence) {
+			if (__atomic_load_n(&t->quit, __ATOMIC_ACQUIRE))
+				error(1, t->poll_error,
+				      "WAIT_FENCE %u nonblocking on pipe %u",
+				      fence, t->pipe);
+		}
+		seen = t->seen_ns;
+
+		if (i < WARMUP)
+			continue;
+
+		hdr_add(&st->submit_ioctl, submitted - start);
+		hdr_add(&st->submit_to_signal, seen - start);
+		hdr_add(&st->submit_to_wake, woken - start);
+		if (woken < seen) {
+			st->early_wakes++;
+			hdr_add(&st->signal_to_wake, 0);
+		} else {
+			hdr_add(&st->signal_to_wake, woken - seen);
+		}
+		if (period)
+			hdr_add(&st->period_jitter, start - next);
+
+		trace_event(trace, "submit", t->pipe, start, submitted, t0);
+		trace_event(trace, "gpu", t->pipe, submitted, seen, t0);
+		trace_event(trace, "wake", t->pipe, seen, woken, t0);
+	}
+
+	__atomic_store_n(&t->quit, 1, __ATOMIC_RELEASE);
+	pthread_join(t->poller, NULL);
+}
+
+static void report_pipe(enum bench_format format, const struct fence_trace *t,
+	const struct pipe_stats *st, unsigned int count, uint64_t period)
+{
+	bench_report_start(format, "fence");
+	bench_report_value(format, "pipe", "%.0f", t->pipe);
+	bench_report_string(format, "exec_state", pipe_names[t->exec_state]);
+	bench_report_value(format, "submits", "%.0f", count);
+	bench_report_value(format, "period_us", "%.0f", period / 1e3);
+	bench_report_value(format, "early_wakes", "%.0f", st->early_wakes);
+	bench_report_hdr(format, "submit_ioctl", &st->submit_ioctl);
+	bench_report_hdr(format, "submit_to_signal", &st->submit_to_signal);
+	bench_report_hdr(format, "signal_to_wake", &st->signal_to_wake);
+	bench_report_hdr(format, "submit_to_wake", &st->submit_to_wake);
+	if (period)
+		bench_report_hdr(format, "period_jitter", &st->period_jitter);
+	bench_report_end(format);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-d DEVICE] [-p PIPE,...] [-n COUNT] [-i PERIOD_US] [-o TRACE]\n"
+		"       [-f text|json]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t stream[2] = { CMD_NOP, 0 };
+	unsigned int count = 1000, pipes = 0, pipe;
+	struct fence_trace t = { 0 };
+	struct pipe_stats *st;
+	const char *device = NULL, *trace_name = NULL;
+	char *tok, *save, *end;
+	int opt, format = BENCH_TEXT, state;
+	uint64_t period = 0, t0;
+	FILE *trace = NULL;
+
+	while ((opt = getopt(argc, argv, "d:p:n:i:o:f:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'p':
+			for (tok = strtok_r(optarg, ",", &save); tok;
+			     tok = strtok_r(NULL, ",", &save)) {
+				pipe = strtoul(tok, &end, 0);
+				if (*end || pipe >= ETNA_MAX_PIPES)
+					usage(argv[0]);
+				pipes |= 1 << pipe;
+			}
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			period = strtoull(optarg, NULL, 0) * 1000;
+			break;
+		case 'o':
+			trace_name = optarg;
+			break;
+		case 'f':
+			format = bench_format(optarg);
+			if (format < 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc || !count)
+		usage(argv[0]);
+
+	t.fd = render_open(device, NULL, 0);
+	if (t.fd == -1)
+		error(1, errno, "%s", device ? device : "etnaviv render node");
+
+	if (!pipes) {
+		for (pipe = 0; pipe < ETNA_MAX_PIPES; pipe++)
+			if (pipe_exec_state(t.fd, pipe) >= 0)
+				pipes |= 1 << pipe;
+		if (!pipes)
+			error(1, 0, "no GPU cores found");
+	}
+
+	if (trace_name) {
+		trace = fopen(trace_name, "w");
+		if (!trace)
+			error(1, errno, "%s", trace_name);
+		fprintf(trace, "[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+			"\"args\":{\"name\":\"etnaviv\"}}");
+	}
+
+	st = malloc(sizeof(*st));
+	if (!st)
+		error(1, ENOMEM, "histograms");
+
+	t.req.nr_bos = 0;
+	t.req.nr_relocs = 0;
+	t.req.stream_size = sizeof(stream);
+	t.req.stream = (uintptr_t)stream;
+
+	t0 = bench_now();
+	for (pipe = 0; pipe < ETNA_MAX_PIPES; pipe++) {
+		if (!(pipes & 1 << pipe))
+			continue;
+
+		state = pipe_exec_state(t.fd, pipe);
+		if (state < 0)
+			error(1, 0, "no GPU core on pipe %u", pipe);
+
+		t.pipe = pipe;
+		t.exec_state = state;
+		t.req.exec_state = state;
+
+		if (trace)
+			fprintf(trace, ",\n{\"name\":\"thread_name\",\"ph\":\"M\","
+				"\"pid\":1,\"tid\":%u,\"args\":{\"name\":"
+				"\"pipe %u (%s)\"}}", pipe, pipe,
+				pipe_names[state]);
+
+		memset(st, 0, sizeof(*st));
+		run_pipe(&t, st, count, period, trace, t0);
+		report_pipe(format, &t, st, count, period);
+	}
+
+	if (trace) {
+		fprintf(trace, "\n]\n");
+		if (fclose(trace))
+			error(1, errno, "%s", trace_name);
+	}
+
+	free(st);
+	close(t.fd);
+
+	return 0;
+}
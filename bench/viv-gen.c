@@ -0,0 +1,555 @@
+/*
+ * Synthetic benchmark inputs, the same for the same seed.
+ *
+ *   cmd		a command stream of draws
+ *   dump	a devcoredump: registers, MMU, ring, command buffers, BO map
+ *		and BOs, the FE hung at the last draw
+ *   surface	a tiled surface of random pixels
+ *
+ * Each draw of a command stream reloads every block of state in a table
+ * of FE, VS, PA, SE, RA, PS, PE and TE state with CHURN percent
+ * probability, uniforms and shader code included, now and then
+ * semaphore-stalls, and ends in an indexed or plain draw.  Every stream
+ * starts with all state loaded and the colour and depth surfaces of the
+ * dump's BOs bound, so viv-extract-rt finds them.  The size is given as
+ * a number of draws or, with -z, as the bytes of command stream to
+ * write, spread over CMDBUFS command buffers in a dump.
+ */
+#include <errno.h>
+#include <error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "etnaviv_dump.h"
+#include "hw/state.xml.h"
+#include "hw/state_3d.xml.h"
+#include "../cmd/vivcmd.h"
+#include "../info/chipdb.h"
+
+#define ARRAY_SIZE(x)	(sizeof(x) / sizeof((x)[0]))
+#define PAGE_SIZE	4096u
+
+#define RING_IOVA	0x00100000u
+#define CMD_IOVA	0x00200000u
+#define BO_IOVA		0x80000000u
+#define PHYS_BASE	0x10000000u
+
+#define CMD_LOAD_STATE(reg, num)	\
+	(VIVCMD_LOAD_STATE << 27 | ((num) & 0x3ff) << 16 | (reg) >> 2)
+
+/* BOs of a dump, which the state points into */
+enum {
+	BO_COLOR,
+	BO_DEPTH,
+	BO_INDEX,
+	BO_VERTEX,
+	BO_TEXTURE,
+	NR_BOS = BO_TEXTURE + 4,
+};
+
+enum {
+	VALUE,		/* random */
+	FLOAT,		/* random in [-1, 1] */
+	ADDR,		/* into a BO */
+};
+
+/* State reloaded as a whole with the churn probability */
+static const struct block {
+	uint32_t reg;
+	uint16_t num, max;	/* num to max states */
+	uint8_t kind;
+	uint8_t bo;
+} blocks[] = {
+	{ VIVS_FE_VERTEX_ELEMENT_CONFIG(0), 4, 16, VALUE },
+	{ VIVS_FE_INDEX_STREAM_BASE_ADDR, 1, 1, ADDR, BO_INDEX },
+	{ VIVS_FE_INDEX_STREAM_CONTROL, 1, 1, VALUE },
+	{ VIVS_FE_VERTEX_STREAM_BASE_ADDR, 1, 1, ADDR, BO_VERTEX },
+	{ VIVS_FE_VERTEX_STREAM_CONTROL, 1, 1, VALUE },
+	{ 0x00800, 4, 8, VALUE },		/* VS */
+	{ 0x00a80, 4, 4, FLOAT },		/* PA */
+	{ 0x00c00, 4, 4, VALUE },		/* SE scissor */
+	{ 0x00e00, 2, 2, VALUE },		/* RA */
+	{ 0x01000, 4, 4, VALUE },		/* PS */
+	{ 0x01404, 3, 3, FLOAT },		/* PE depth range */
+	{ 0x01418, 5, 5, VALUE },		/* PE stencil, alpha */
+	{ 0x02000, 1, 12, VALUE },		/* TE sampler config */
+	{ 0x02040, 1, 12, VALUE },		/* TE sampler size */
+	{ 0x02400, 1, 4, ADDR, BO_TEXTURE },	/* TE sampler LOD 0 */
+	{ 0x04000, 64, 512, VALUE },		/* VS instructions */
+	{ 0x05000, 16, 168, FLOAT },		/* VS uniforms */
+	{ 0x06000, 64, 512, VALUE },		/* PS instructions */
+	{ 0x07000, 8, 64, FLOAT },		/* PS uniforms */
+};
+
+/* Registers of a dump; the chip is a GC2000 */
+static const struct etnaviv_dump_registers dump_regs[] = {
+	{ 0x000, 0x00000900 },			/* clock control */
+	{ 0x004, 0x7ffffffe },			/* idle: FE busy */
+	{ 0x00c, 0x00000000 },			/* AXI status */
+	{ VIVS_HI_CHIP_FEATURE, 0xe0296cad },
+	{ VIVS_HI_CHIP_MODEL, 0x2000 },
+	{ VIVS_HI_CHIP_REV, 0x5108 },
+	{ VIVS_HI_CHIP_MINOR_FEATURE_0, 0xc9799eff },
+	{ VIVS_HI_CHIP_MINOR_FEATURE_1, 0x2efbf2d9 },
+	{ VIVS_HI_CHIP_MINOR_FEATURE_2, 0 },
+	{ VIVS_HI_CHIP_MINOR_FEATURE_3, 0 },
+	{ VIVS_HI_CHIP_MINOR_FEATURE_4, 0 },
+	{ VIVS_HI_CHIP_MINOR_FEATURE_5, 0 },
+	{ 0x660, 0x00000812 },			/* DMA debug: draw */
+	{ VIVS_FE_DMA_ADDRESS, 0 },		/* filled in */
+	{ 0x668, 0 },				/* fetched words */
+	{ 0x66c, 0 },
+};
+
+struct gen {
+	uint64_t x;		/* xorshift64 state */
+	unsigned int churn;	/* percent */
+	unsigned int width, height;
+	uint32_t bo_iova[NR_BOS];
+	uint32_t bo_size[NR_BOS];
+
+	/* The stream being written */
+	FILE *f;
+	const char *name;
+	uint64_t words;
+	uint64_t last_draw;	/* word offset */
+	uint32_t buf[4096];
+	unsigned int n;
+};
+
+static uint64_t next(struct gen *g)
+{
+	g->x ^= g->x << 13;
+	g->x ^= g->x >> 7;
+	g->x ^= g->x << 17;
+	return g->x;
+}
+
+static uint32_t f2u(float f)
+{
+	union {
+		float f;
+		uint32_t u;
+	} v = { .f = f };
+
+	return v.u;
+}
+
+static void out(struct gen *g, const void *data, size_t size)
+{
+	if (size && fwrite(data, size, 1, g->f) != 1)
+		error(1, errno, "%s", g->name);
+}
+
+static void flush(struct gen *g)
+{
+	out(g, g->buf, g->n * sizeof(uint32_t));
+	g->n = 0;
+}
+
+static void put(struct gen *g, uint32_t w)
+{
+	if (g->n == ARRAY_SIZE(g->buf))
+		flush(g);
+	g->buf[g->n++] = w;
+	g->words++;
+}
+
+static void pad(struct gen *g)
+{
+	if (g->words % 2)
+		put(g, 0);
+}
+
+static void load_state(struct gen *g, uint32_t reg, const uint32_t *v,
+	unsigned int num)
+{
+	unsigned int i;
+
+	put(g, CMD_LOAD_STATE(reg, num));
+	for (i = 0; i < num; i++)
+		put(g, v[i]);
+	pad(g);
+}
+
+static void load_block(struct gen *g, const struct block *b)
+{
+	unsigned int num = b->num, i;
+	uint32_t v;
+
+	if (b->max > b->num)
+		num += next(g) % (b->max - b->num + 1);
+
+	put(g, CMD_LOAD_STATE(b->reg, num));
+	for (i = 0; i < num; i++) {
+		switch (b->kind) {
+		case FLOAT:
+			v = f2u((int32_t)next(g) / 2147483648.0f);
+			break;
+		case ADDR:
+			v = g->bo_iova[b->bo + i] +
+			    (next(g) % (g->bo_size[b->bo + i] / 2) & ~63);
+			break;
+		default:
+			v = next(g);
+		}
+		put(g, v);
+	}
+	pad(g);
+}
+
+/* Everything, and the render targets */
+static void preamble(struct gen *g)
+{
+	uint32_t v[4];
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(blocks); i++)
+		load_block(g, &blocks[i]);
+
+	v[0] = f2u(g->width / 2.0f);
+	v[1] = f2u(-(g->height / 2.0f));
+	load_state(g, VIVS_PA_VIEWPORT_SCALE_X, v, 2);
+	v[0] = 0;
+	load_state(g, VIVS_TS_MEM_CONFIG, v, 1);
+	v[0] = VIVS_PE_COLOR_FORMAT_FORMAT(RS_FORMAT_A8R8G8B8);
+	load_state(g, VIVS_PE_COLOR_FORMAT, v, 1);
+	v[0] = g->bo_iova[BO_COLOR];
+	v[1] = g->width * 4;
+	load_state(g, VIVS_PE_COLOR_ADDR, v, 2);
+	v[0] = VIVS_PE_DEPTH_CONFIG_DEPTH_FORMAT_D24S8;
+	load_state(g, VIVS_PE_DEPTH_CONFIG, v, 1);
+	v[0] = g->bo_iova[BO_DEPTH];
+	v[1] = g->width * 4;
+	load_state(g, VIVS_PE_DEPTH_ADDR, v, 2);
+}
+
+static void draw(struct gen *g)
+{
+	static const uint32_t token = 0x701;	/* FE to PE */
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(blocks); i++)
+		if (next(g) % 100 < g->churn)
+			load_block(g, &blocks[i]);
+
+	if (next(g) % 400 < g->churn) {
+		load_state(g, VIVS_GL_SEMAPHORE_TOKEN, &token, 1);
+		put(g, VIVCMD_STALL << 27);
+		put(g, token);
+	}
+
+	g->last_draw = g->words;
+	if (next(g) % 2) {
+		put(g, VIVCMD_DRAW_PRIMITIVES << 27);
+		put(g, 4);
+		put(g, next(g) % 1024);
+		put(g, 1 + next(g) % 4096);
+	} else {
+		put(g, VIVCMD_DRAW_INDEXED_PRIMITIVES << 27);
+		put(g, 4);
+		put(g, next(g) % 1024);
+		put(g, 1 + next(g) % 4096);
+		put(g, 0);
+		put(g, 0);
+	}
+}
+
+/* Write draws until both limits are met, returning the stream's words */
+static uint64_t write_stream(struct gen *g, uint64_t draws, uint64_t bytes)
+{
+	uint64_t i;
+
+	g->words = 0;
+	preamble(g);
+	for (i = 0; i < draws || g->words * 4 < bytes; i++)
+		draw(g);
+
+	return g->words;
+}
+
+static void write_random(struct gen *g, uint64_t size)
+{
+	uint64_t v;
+
+	for (; size >= 8; size -= 8) {
+		v = next(g);
+		if (g->n + 2 > ARRAY_SIZE(g->buf))
+			flush(g);
+		memcpy(&g->buf[g->n], &v, 8);
+		g->n += 2;
+	}
+	flush(g);
+	v = next(g);
+	out(g, &v, size);
+}
+
+static void write_zero(struct gen *g, uint64_t size)
+{
+	static const uint8_t zero[PAGE_SIZE];
+
+	for (; size > sizeof(zero); size -= sizeof(zero))
+		out(g, zero, sizeof(zero));
+	out(g, zero, size);
+}
+
+static uint64_t align(uint64_t v, uint64_t a)
+{
+	return (v + a - 1) / a * a;
+}
+
+static void setup_bos(struct gen *g)
+{
+	uint32_t iova = BO_IOVA;
+	unsigned int i;
+
+	g->bo_size[BO_COLOR] = g->width * g->height * 4;
+	g->bo_size[BO_DEPTH] = g->width * g->height * 4;
+	g->bo_size[BO_INDEX] = 64 * 1024;
+	g->bo_size[BO_VERTEX] = 256 * 1024;
+	for (i = BO_TEXTURE; i < NR_BOS; i++)
+		g->bo_size[i] = 256 * 1024;
+
+	for (i = 0; i < NR_BOS; i++) {
+		g->bo_size[i] = align(g->bo_size[i], PAGE_SIZE);
+		g->bo_iova[i] = iova;
+		iova += g->bo_size[i];
+	}
+}
+
+/*
+ * The dump is written front to back after a blank header, which is
+ * filled in last: command buffers, ring, registers, MMU, BO map and BOs.
+ */
+static void write_dump(struct gen *g, unsigned int nr_cmdbufs,
+	uint64_t draws, uint64_t bytes)
+{
+	struct etnaviv_dump_object_header *hdr;
+	struct etnaviv_dump_registers regs[ARRAY_SIZE(dump_regs)];
+	unsigned int nr_hdr = 5 + nr_cmdbufs + NR_BOS, i, h, j;
+	uint32_t *ring, *mmu, cmd_iova = CMD_IOVA, dma_addr = 0, phys;
+	uint64_t off, words, pages, bomap_pages = 0;
+
+	hdr = calloc(nr_hdr, sizeof(*hdr));
+	ring = calloc(PAGE_SIZE / 4, sizeof(*ring));
+	if (!hdr || !ring)
+		error(1, ENOMEM, "dump");
+	if (4 * (nr_cmdbufs + 2) > PAGE_SIZE)
+		error(1, 0, "too many command buffers");
+
+	for (i = 0; i < nr_hdr; i++)
+		hdr[i].magic = ETDUMP_MAGIC;
+	write_zero(g, nr_hdr * sizeof(*hdr));
+	off = nr_hdr * sizeof(*hdr);
+
+	/* Command buffers, each linking back to the ring as the kernel's */
+	for (i = 0, h = 3; i < nr_cmdbufs; i++, h++) {
+		words = write_stream(g, (draws + i) / nr_cmdbufs,
+				     (bytes + i) / nr_cmdbufs);
+		put(g, VIVCMD_LINK << 27 | 1);
+		put(g, RING_IOVA + (i + 1) * 8);
+		flush(g);
+		words += 2;
+
+		hdr[h].type = ETDUMP_BUF_CMD;
+		hdr[h].file_offset = off;
+		hdr[h].file_size = words * 4;
+		hdr[h].iova = cmd_iova;
+		dma_addr = cmd_iova + g->last_draw * 4;
+
+		ring[i * 2] = VIVCMD_LINK << 27 | (words / 2 & 0xffff);
+		ring[i * 2 + 1] = cmd_iova;
+
+		off += words * 4;
+		cmd_iova += align(words * 4, PAGE_SIZE);
+		if (off >= UINT32_MAX || cmd_iova >= BO_IOVA)
+			error(1, 0, "command buffers too large for a dump");
+	}
+
+	ring[i * 2] = VIVCMD_WAIT << 27 | 200;
+	ring[i * 2 + 2] = VIVCMD_LINK << 27 | 1;
+	ring[i * 2 + 3] = RING_IOVA + i * 8;
+	hdr[2].type = ETDUMP_BUF_RING;
+	hdr[2].file_offset = off;
+	hdr[2].file_size = PAGE_SIZE;
+	hdr[2].iova = RING_IOVA;
+	out(g, ring, PAGE_SIZE);
+	off += PAGE_SIZE;
+
+	memcpy(regs, dump_regs, sizeof(regs));
+	for (i = 0; i < ARRAY_SIZE(regs); i++)
+		if (regs[i].reg == VIVS_FE_DMA_ADDRESS)
+			regs[i].value = dma_addr;
+	hdr[0].type = ETDUMP_BUF_REG;
+	hdr[0].file_offset = off;
+	hdr[0].file_size = sizeof(regs);
+	out(g, regs, sizeof(regs));
+	off += sizeof(regs);
+
+	/* MMUv1: one entry per page from BO_IOVA, the BOs' pages scattered */
+	pages = (g->bo_iova[NR_BOS - 1] + g->bo_size[NR_BOS - 1] - BO_IOVA) /
+		PAGE_SIZE;
+	mmu = malloc(pages * sizeof(*mmu));
+	if (!mmu)
+		error(1, ENOMEM, "MMU");
+	phys = PHYS_BASE;
+	for (j = 0; j < pages; j++) {
+		phys += PAGE_SIZE * (1 + next(g) % 4);
+		mmu[j] = phys;
+	}
+
+	hdr[1].type = ETDUMP_BUF_MMU;
+	hdr[1].file_offset = off;
+	hdr[1].file_size = pages * 4;
+	out(g, mmu, pages * 4);
+	off += pages * 4;
+	write_zero(g, align(off, 8) - off);
+	off = align(off, 8);
+
+	/* The BO map holds the same pages, as 64-bit addresses */
+	h = 3 + nr_cmdbufs;
+	hdr[h].type = ETDUMP_BUF_BOMAP;
+	hdr[h].file_offset = off;
+	hdr[h].file_size = pages * 8;
+	for (j = 0; j < pages; j++) {
+		uint64_t v = mmu[j];
+
+		out(g, &v, sizeof(v));
+	}
+	off += pages * 8;
+	free(mmu);
+
+	for (i = 0, h++; i < NR_BOS; i++, h++) {
+		hdr[h].type = ETDUMP_BUF_BO;
+		hdr[h].file_offset = off;
+		hdr[h].file_size = g->bo_size[i];
+		hdr[h].iova = g->bo_iova[i];
+		hdr[h].data[0] = bomap_pages;
+		bomap_pages += g->bo_size[i] / PAGE_SIZE;
+		write_random(g, g->bo_size[i]);
+		off += g->bo_size[i];
+		if (off >= UINT32_MAX)
+			error(1, 0, "dump too large");
+	}
+
+	hdr[h].type = ETDUMP_BUF_END;
+
+	if (fseek(g->f, 0, SEEK_SET))
+		error(1, errno, "%s", g->name);
+	out(g, hdr, nr_hdr * sizeof(*hdr));
+
+	free(ring);
+	free(hdr);
+}
+
+static uint64_t parse_size(const char *arg)
+{
+	uint64_t v;
+	char *end;
+
+	v = strtoull(arg, &end, 0);
+	if (*end == 'k')
+		v <<= 10, end++;
+	else if (*end == 'M')
+		v <<= 20, end++;
+	else if (*end == 'G')
+		v <<= 30, end++;
+
+	return *end ? 0 : v;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-s SEED] [-n DRAWS | -z SIZE] [-c CHURN] cmd FILE\n"
+		"       %s [-s SEED] [-n DRAWS | -z SIZE] [-c CHURN] [-k CMDBUFS] [-w WIDTH] [-h HEIGHT]\n"
+		"          dump FILE\n"
+		"       %s [-s SEED] [-w WIDTH] [-h HEIGHT] [-b BYTES_PER_PIXEL] surface FILE\n"
+		"SIZE may have a k, M or G suffix, CHURN is in percent\n",
+		prog, prog, prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct gen g = {
+		.x = 1,
+		.churn = 20,
+		.width = 1024,
+		.height = 512,
+	};
+	unsigned int nr_cmdbufs = 4, bpp = 4;
+	uint64_t draws = 1000, bytes = 0;
+	const char *mode;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:n:z:c:k:w:h:b:")) != -1) {
+		switch (opt) {
+		case 's':
+			g.x = strtoull(optarg, NULL, 0);
+			break;
+		case 'n':
+			draws = strtoull(optarg, NULL, 0);
+			break;
+		case 'z':
+			bytes = parse_size(optarg);
+			if (!bytes)
+				usage(argv[0]);
+			draws = 0;
+			break;
+		case 'c':
+			g.churn = strtoul(optarg, NULL, 0);
+			if (g.churn > 100)
+				usage(argv[0]);
+			break;
+		case 'k':
+			nr_cmdbufs = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			g.width = strtoul(optarg, NULL, 0);
+			break;
+		case 'h':
+			g.height = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			bpp = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 2 || !nr_cmdbufs || !bpp || g.width % 16 ||
+	    g.height % 4 || !g.width || !g.height)
+		usage(argv[0]);
+
+	/* xorshift has no zero state; spread small seeds out */
+	g.x = g.x * 0x9e3779b97f4a7c15ull + 0x2545f4914f6cdd1dull;
+	if (!g.x)
+		g.x = 1;
+
+	mode = argv[optind];
+	g.name = argv[optind + 1];
+	g.f = fopen(g.name, "w");
+	if (!g.f)
+		error(1, errno, "%s", g.name);
+
+	setup_bos(&g);
+	if (!strcmp(mode, "cmd")) {
+		write_stream(&g, draws, bytes);
+		flush(&g);
+	} else if (!strcmp(mode, "dump")) {
+		write_dump(&g, nr_cmdbufs, draws, bytes);
+	} else if (!strcmp(mode, "surface")) {
+		write_random(&g, (uint64_t)g.width * g.height * bpp);
+	} else {
+		usage(argv[0]);
+	}
+
+	if (fclose(g.f))
+		error(1, errno, "%s", g.name);
+
+	return 0;
+}
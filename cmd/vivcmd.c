@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "vivcmd.h"
+
+static const char *const opcode_names[VIVCMD_NR_OPCODES] = {
+	[VIVCMD_ZERO] = "ZERO",
+	[VIVCMD_LOAD_STATE] = "LOAD_STATE",
+	[VIVCMD_END] = "END",
+	[VIVCMD_NOP] = "NOP",
+	[VIVCMD_DRAW_2D] = "DRAW_2D",
+	[VIVCMD_DRAW_PRIMITIVES] = "DRAW_PRIMITIVES",
+	[VIVCMD_DRAW_INDEXED_PRIMITIVES] = "DRAW_INDEXED_PRIMITIVES",
+	[VIVCMD_WAIT] = "WAIT",
+	[VIVCMD_LINK] = "LINK",
+	[VIVCMD_STALL] = "STALL",
+	[VIVCMD_CALL] = "CALL",
+	[VIVCMD_RETURN] = "RETURN",
+	[VIVCMD_DRAW_INSTANCED] = "DRAW_INSTANCED",
+	[VIVCMD_CHIP_SELECT] = "CHIP_SELECT",
+};
+
+int vivcmd_stream_open(struct vivcmd_stream *s, const char *name)
+{
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		return -1;
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	if (st.st_size) {
+		ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr == (void *)-1) {
+			close(fd);
+			return -1;
+		}
+		madvise(ptr, st.st_size, MADV_SEQUENTIAL);
+	} else {
+		ptr = NULL;
+	}
+	close(fd);
+
+	s->buf = ptr;
+	s->size = st.st_size / sizeof(uint32_t);
+	s->pos = 0;
+
+	return 0;
+}
+
+void vivcmd_stream_close(struct vivcmd_stream *s)
+{
+	if (s->buf)
+		munmap((void *)s->buf, s->size * sizeof(uint32_t));
+	s->buf = NULL;
+}
+
+const char *vivcmd_opcode_name(unsigned int opcode)
+{
+	if (opcode >= VIVCMD_NR_OPCODES || !opcode_names[opcode])
+		return NULL;
+	return opcode_names[opcode];
+}
+
+/* Length of the command starting with @word, or 0 for an unknown opcode */
+static inline unsigned int op_words(uint32_t word)
+{
+	unsigned int num;
+
+	switch (word >> 27) {
+	case VIVCMD_LOAD_STATE:
+		num = (word >> 16) & 0x3ff;
+		if (num == 0)
+			num = 0x400;
+		return (num + 2) & ~1;
+	case VIVCMD_DRAW_2D:
+		num = (word >> 16) & 0x3ff;
+		return 2 + ((word >> 8) & 0xff) * 2 + ((num + 1) & ~1);
+	case VIVCMD_DRAW_PRIMITIVES:
+	case VIVCMD_CALL:
+	case VIVCMD_DRAW_INSTANCED:
+		return 4;
+	case VIVCMD_DRAW_INDEXED_PRIMITIVES:
+		return 6;
+	case VIVCMD_ZERO:
+	case VIVCMD_END:
+	case VIVCMD_NOP:
+	case VIVCMD_WAIT:
+	case VIVCMD_LINK:
+	case VIVCMD_STALL:
+	case VIVCMD_RETURN:
+	case VIVCMD_CHIP_SELECT:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+static inline int visit_state(const struct vivcmd_visitor *v, void *priv,
+	const uint32_t *words)
+{
+	uint32_t addr = words[0] & 0xffff;
+	unsigned int num, first;
+	int ret;
+
+	num = (words[0] >> 16) & 0x3ff;
+	if (num == 0)
+		num = 0x400;
+
+	/* Split where the address wraps */
+	first = 0x10000 - addr;
+	if (num <= first)
+		return v->state(priv, addr, words + 1, num);
+
+	ret = v->state(priv, addr, words + 1, first);
+	if (ret)
+		return ret;
+	return v->state(priv, 0, words + 1 + first, num - first);
+}
+
+/*
+ * Walk the stream from its position, calling the visitor for each
+ * command.  Returns 0 at the end of the stream, or what a callback
+ * returned with the position after that command.  An unknown opcode
+ * fails with EINVAL and a truncated command with EIO, both with the
+ * position at the command.
+ */
+int vivcmd_parse(struct vivcmd_stream *s, const struct vivcmd_visitor *v,
+	void *priv)
+{
+	const uint32_t *buf = s->buf;
+	size_t pos = s->pos, size = s->size;
+	struct vivcmd_op op;
+	unsigned int n;
+	int ret;
+
+	while (pos < size) {
+		n = op_words(buf[pos]);
+		if (n == 0) {
+			s->pos = pos;
+			errno = EINVAL;
+			return -1;
+		}
+		if (n > size - pos) {
+			s->pos = pos;
+			errno = EIO;
+			return -1;
+		}
+
+		op.opcode = buf[pos] >> 27;
+		op.nr_words = n;
+		op.pos = pos;
+		op.words = buf + pos;
+		pos += n;
+
+		ret = 0;
+		if (v->op)
+			ret = v->op(priv, &op);
+		if (!ret && v->state && op.opcode == VIVCMD_LOAD_STATE)
+			ret = visit_state(v, priv, op.words);
+		if (!ret && v->draw &&
+		    (op.opcode == VIVCMD_DRAW_PRIMITIVES ||
+		     op.opcode == VIVCMD_DRAW_INDEXED_PRIMITIVES ||
+		     op.opcode == VIVCMD_DRAW_INSTANCED))
+			ret = v->draw(priv, &op);
+		if (ret) {
+			s->pos = pos;
+			return ret;
+		}
+	}
+
+	s->pos = pos;
+	return 0;
+}
@@ -0,0 +1,62 @@
+#ifndef VIVCMD_H
+#define VIVCMD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* FE command opcodes, bits 31:27 of the first word */
+enum {
+	VIVCMD_ZERO = 0x00,	/* not a command; zero fill, skipped */
+	VIVCMD_LOAD_STATE = 0x01,
+	VIVCMD_END = 0x02,
+	VIVCMD_NOP = 0x03,
+	VIVCMD_DRAW_2D = 0x04,
+	VIVCMD_DRAW_PRIMITIVES = 0x05,
+	VIVCMD_DRAW_INDEXED_PRIMITIVES = 0x06,
+	VIVCMD_WAIT = 0x07,
+	VIVCMD_LINK = 0x08,
+	VIVCMD_STALL = 0x09,
+	VIVCMD_CALL = 0x0a,
+	VIVCMD_RETURN = 0x0b,
+	VIVCMD_DRAW_INSTANCED = 0x0c,
+	VIVCMD_CHIP_SELECT = 0x0d,
+	VIVCMD_NR_OPCODES = 0x20,
+};
+
+/* A command stream, usually mapped from a file */
+struct vivcmd_stream {
+	const uint32_t *buf;
+	size_t size;		/* in words */
+	size_t pos;		/* in words */
+};
+
+/* One command: the words point into the stream */
+struct vivcmd_op {
+	unsigned int opcode;
+	unsigned int nr_words;	/* including padding to 64 bits */
+	size_t pos;		/* in words */
+	const uint32_t *words;
+};
+
+/*
+ * Callbacks of vivcmd_parse(), any of which may be NULL.  op is called
+ * for every command.  state is then called for the values of a LOAD_STATE,
+ * split where the state address wraps, with @addr in words.  draw is
+ * called for the 3D draw commands.  A callback returning non-zero stops
+ * the parse with that value, after the command.
+ */
+struct vivcmd_visitor {
+	int (*op)(void *priv, const struct vivcmd_op *op);
+	int (*state)(void *priv, uint32_t addr, const uint32_t *values,
+		     unsigned int num);
+	int (*draw)(void *priv, const struct vivcmd_op *op);
+};
+
+int vivcmd_stream_open(struct vivcmd_stream *s, const char *name);
+void vivcmd_stream_close(struct vivcmd_stream *s);
+
+int vivcmd_parse(struct vivcmd_stream *s, const struct vivcmd_visitor *v,
+	void *priv);
+const char *vivcmd_opcode_name(unsigned int opcode);
+
+#endif
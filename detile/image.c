@@ -0,0 +1,691 @@
+/*
+ * Image output, a chunk of lines at a time.
+ *
+ * Unless a pixel format is given, pixels are read the way bin2img reads
+ * them: byte 0 is red, byte 1 green, byte 2 blue, and with 4-byte pixels
+ * byte 3 is alpha (PAM) or dropped (PPM, PNG).  1-byte pixels, and depth
+ * formats, are written as greyscale.
+ *
+ * PNG lines use the Up filter, which needs only the line above, so each
+ * chunk is converted in parallel.  The filtered data is then cut into
+ * blocks which are deflated in parallel, each primed with the 32KiB of
+ * data before it as the dictionary and ended with a sync flush, so the
+ * blocks concatenate into one zlib stream.  The adler32 of the stream is
+ * combined from the per-block checksums.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "image.h"
+#include "job.h"
+
+enum {
+	PNG_WINDOW = 32 * 1024,
+	PNG_FILTER_UP = 2,
+};
+
+struct png_block {
+	uint8_t *out;
+	size_t out_alloc;
+	size_t out_len;
+	uint32_t adler;
+	int err;
+};
+
+struct image {
+	int fd;
+	enum image_format format;
+	unsigned int width;
+	unsigned int height;
+	unsigned int cpp;
+	enum image_pixel pixel;
+	unsigned int channels;
+	unsigned int lines;		/* written so far */
+	size_t raw_size;		/* bytes left, bounded raw only */
+	size_t line_bytes;		/* converted line */
+	uint8_t *buf;
+	size_t buf_alloc;
+	int err;			/* from a job */
+
+	/* PNG */
+	uint8_t *prev;			/* source of the last line written */
+	size_t history;			/* valid bytes before buf + PNG_WINDOW */
+	uint32_t adler;
+	int finished;
+	struct png_block *blocks;
+	unsigned int nr_blocks;
+};
+
+ssize_t safe_read(int fd, void *buf, size_t size)
+{
+	size_t rd = 0;
+	ssize_t ret;
+
+	while (size) {
+		ret = read(fd, buf, size);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return rd ? rd : ret;
+		rd += ret;
+		buf += ret;
+		size -= ret;
+	}
+
+	return rd;
+}
+
+ssize_t safe_write(int fd, const void *buf, size_t size)
+{
+	size_t written = 0;
+	ssize_t ret;
+
+	while (size) {
+		ret = write(fd, buf, size);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return written ? written : ret;
+		written += ret;
+		buf += ret;
+		size -= ret;
+	}
+
+	return written;
+}
+
+static int write_all(int fd, const void *buf, size_t size)
+{
+	ssize_t ret = safe_write(fd, buf, size);
+
+	if (ret == size)
+		return 0;
+	if (ret >= 0)
+		errno = EIO;
+	return -1;
+}
+
+static void put_be32(uint8_t *p, uint32_t v)
+{
+	p[0] = v >> 24;
+	p[1] = v >> 16;
+	p[2] = v >> 8;
+	p[3] = v;
+}
+
+int image_format(const char *name)
+{
+	static const char *const names[] = {
+		[IMAGE_RAW] = "raw",
+		[IMAGE_PPM] = "ppm",
+		[IMAGE_PAM] = "pam",
+		[IMAGE_PNG] = "png",
+	};
+	unsigned int i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (!strcmp(name, names[i]))
+			return i;
+
+	return -1;
+}
+
+/* A PNG chunk made of @nr pieces */
+static int png_chunk(struct image *img, const char *type,
+	const void *const *data, const size_t *len, unsigned int nr)
+{
+	uint8_t hdr[8], crc[4];
+	size_t size = 0;
+	uLong c;
+	unsigned int i;
+
+	for (i = 0; i < nr; i++)
+		size += len[i];
+
+	put_be32(hdr, size);
+	memcpy(hdr + 4, type, 4);
+	c = crc32(0, hdr + 4, 4);
+	for (i = 0; i < nr; i++)
+		c = crc32(c, data[i], len[i]);
+	put_be32(crc, c);
+
+	if (write_all(img->fd, hdr, sizeof(hdr)))
+		return -1;
+	for (i = 0; i < nr; i++)
+		if (write_all(img->fd, data[i], len[i]))
+			return -1;
+	return write_all(img->fd, crc, sizeof(crc));
+}
+
+static int write_header(struct image *img)
+{
+	char hdr[128];
+	int len;
+
+	switch (img->format) {
+	case IMAGE_RAW:
+		return 0;
+	case IMAGE_PPM:
+		len = snprintf(hdr, sizeof(hdr), "P%c\n%u %u\n255\n",
+			       img->channels == 1 ? '5' : '6',
+			       img->width, img->height);
+		break;
+	case IMAGE_PAM:
+		len = snprintf(hdr, sizeof(hdr),
+			       "P7\nWIDTH %u\nHEIGHT %u\nDEPTH %u\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+			       img->width, img->height, img->channels,
+			       img->channels == 1 ? "GRAYSCALE" :
+			       img->channels == 3 ? "RGB" : "RGB_ALPHA");
+		break;
+	case IMAGE_PNG: {
+		static const uint8_t sig[8] = {
+			0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n',
+		};
+		uint8_t ihdr[13];
+		const void *data = ihdr;
+		size_t size = sizeof(ihdr);
+
+		put_be32(ihdr, img->width);
+		put_be32(ihdr + 4, img->height);
+		ihdr[8] = 8;
+		ihdr[9] = img->channels == 1 ? 0 : 2;
+		ihdr[10] = ihdr[11] = ihdr[12] = 0;
+
+		if (write_all(img->fd, sig, sizeof(sig)))
+			return -1;
+		return png_chunk(img, "IHDR", &data, &size, 1);
+	}
+	default:
+		errno = EINVAL;
+		return -1;
+	}
+
+	return write_all(img->fd, hdr, len);
+}
+
+static const struct {
+	unsigned char cpp;
+	unsigned char alpha;
+	unsigned char grey;
+} pixels[] = {
+	[PIXEL_RGBX8] = { 4, 1, 0 },
+	[PIXEL_GREY8] = { 1, 0, 1 },
+	[PIXEL_X4R4G4B4] = { 2, 0, 0 },
+	[PIXEL_A4R4G4B4] = { 2, 1, 0 },
+	[PIXEL_X1R5G5B5] = { 2, 0, 0 },
+	[PIXEL_A1R5G5B5] = { 2, 1, 0 },
+	[PIXEL_R5G6B5] = { 2, 0, 0 },
+	[PIXEL_X8R8G8B8] = { 4, 0, 0 },
+	[PIXEL_A8R8G8B8] = { 4, 1, 0 },
+	[PIXEL_D16] = { 2, 0, 1 },
+	[PIXEL_D24S8] = { 4, 0, 1 },
+};
+
+unsigned int image_pixel_size(enum image_pixel pixel)
+{
+	return pixels[pixel].cpp;
+}
+
+static struct image *image_create(int fd, enum image_format format,
+	unsigned int width, unsigned int height, unsigned int cpp,
+	enum image_pixel pixel)
+{
+	struct image *img;
+
+	img = calloc(1, sizeof(*img));
+	if (!img)
+		return NULL;
+
+	img->fd = fd;
+	img->format = format;
+	img->pixel = pixel;
+	img->width = width;
+	img->height = height;
+	img->cpp = cpp;
+	img->channels = pixels[pixel].grey ? 1 :
+			format == IMAGE_PAM && pixels[pixel].alpha ? 4 : 3;
+	img->line_bytes = (size_t)width * img->channels;
+	img->adler = 1;
+
+	if (format == IMAGE_RAW) {
+		if (height != IMAGE_UNBOUNDED)
+			img->raw_size = (size_t)width * height * cpp;
+	} else if (format == IMAGE_PNG) {
+		img->line_bytes += 1;
+		img->prev = calloc(width, cpp);
+		if (!img->prev)
+			goto fail;
+	}
+
+	if (write_header(img))
+		goto fail;
+
+	return img;
+
+fail:
+	free(img->prev);
+	free(img);
+	return NULL;
+}
+
+/* Raw output takes any pixel size, the image formats 1 or 4 bytes */
+struct image *image_open(int fd, enum image_format format, unsigned int width,
+	unsigned int height, unsigned int cpp)
+{
+	if (format == IMAGE_RAW)
+		return image_create(fd, format, width, height, cpp,
+				    PIXEL_RGBX8);
+
+	if (cpp != 1 && cpp != 4) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return image_open_pixel(fd, format, width, height,
+				cpp == 1 ? PIXEL_GREY8 : PIXEL_RGBX8);
+}
+
+struct image *image_open_pixel(int fd, enum image_format format,
+	unsigned int width, unsigned int height, enum image_pixel pixel)
+{
+	if (height == IMAGE_UNBOUNDED && format != IMAGE_RAW) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	return image_create(fd, format, width, height, pixels[pixel].cpp,
+			    pixel);
+}
+
+static inline uint8_t *put_pixel(uint8_t *dst, unsigned int ch, uint8_t r,
+	uint8_t g, uint8_t b, uint8_t a)
+{
+	dst[0] = r;
+	dst[1] = g;
+	dst[2] = b;
+	if (ch == 4)
+		dst[3] = a;
+
+	return dst + ch;
+}
+
+/* Expand an n-bit channel to 8 bits */
+#define EXPAND(v, n)	((v) << (8 - (n)) | (v) >> (2 * (n) - 8))
+
+/* Decode a line of source pixels into img->channels bytes each */
+static void decode_line(const struct image *img, uint8_t *dst,
+	const uint8_t *src)
+{
+	unsigned int x, c, n = img->width, ch = img->channels;
+	uint16_t v;
+
+	switch (img->pixel) {
+	case PIXEL_RGBX8:
+		if (ch == 4) {
+			memcpy(dst, src, n * 4);
+			break;
+		}
+		for (x = 0; x < n; x++, src += 4)
+			for (c = 0; c < ch; c++)
+				*dst++ = src[c];
+		break;
+	case PIXEL_GREY8:
+		memcpy(dst, src, n);
+		break;
+	case PIXEL_D16:
+		for (x = 0; x < n; x++)
+			dst[x] = src[2 * x + 1];
+		break;
+	case PIXEL_D24S8:
+		for (x = 0; x < n; x++)
+			dst[x] = src[4 * x + 3];
+		break;
+	case PIXEL_X8R8G8B8:
+	case PIXEL_A8R8G8B8:
+		for (x = 0; x < n; x++, src += 4)
+			dst = put_pixel(dst, ch, src[2], src[1], src[0], src[3]);
+		break;
+	case PIXEL_X4R4G4B4:
+	case PIXEL_A4R4G4B4:
+		for (x = 0; x < n; x++, src += 2) {
+			v = src[0] | src[1] << 8;
+			dst = put_pixel(dst, ch, (v >> 8 & 15) * 17,
+					(v >> 4 & 15) * 17, (v & 15) * 17,
+					(v >> 12) * 17);
+		}
+		break;
+	case PIXEL_X1R5G5B5:
+	case PIXEL_A1R5G5B5:
+		for (x = 0; x < n; x++, src += 2) {
+			v = src[0] | src[1] << 8;
+			dst = put_pixel(dst, ch, EXPAND(v >> 10 & 31, 5),
+					EXPAND(v >> 5 & 31, 5),
+					EXPAND(v & 31, 5), v >> 15 ? 255 : 0);
+		}
+		break;
+	case PIXEL_R5G6B5:
+		for (x = 0; x < n; x++, src += 2) {
+			v = src[0] | src[1] << 8;
+			dst = put_pixel(dst, ch, EXPAND(v >> 11, 5),
+					EXPAND(v >> 5 & 63, 6),
+					EXPAND(v & 31, 5), 255);
+		}
+		break;
+	}
+}
+
+struct convert_job {
+	struct image *img;
+	const uint8_t *src;
+	size_t stride;
+	uint8_t *dst;
+};
+
+static void convert_job_lines(void *arg, unsigned int first, unsigned int num)
+{
+	struct convert_job *j = arg;
+	struct image *img = j->img;
+	size_t n = img->line_bytes - 1;
+	uint8_t *line[2], *dst;
+	unsigned int y;
+	size_t i;
+
+	if (img->format != IMAGE_PNG) {
+		for (y = first; y < first + num; y++)
+			decode_line(img, j->dst + y * img->line_bytes,
+				    j->src + y * j->stride);
+		return;
+	}
+
+	/* The Up filter needs the line above decoded as well */
+	line[0] = malloc(2 * n);
+	if (!line[0]) {
+		__atomic_store_n(&img->err, ENOMEM, __ATOMIC_RELAXED);
+		return;
+	}
+	line[1] = line[0] + n;
+
+	decode_line(img, line[0], first ? j->src + (first - 1) * j->stride :
+		    img->prev);
+	for (y = first; y < first + num; y++) {
+		const uint8_t *prev = line[(y - first) & 1];
+		uint8_t *cur = line[(y - first + 1) & 1];
+
+		decode_line(img, cur, j->src + y * j->stride);
+		dst = j->dst + y * img->line_bytes;
+		*dst++ = PNG_FILTER_UP;
+		for (i = 0; i < n; i++)
+			dst[i] = cur[i] - prev[i];
+	}
+
+	free(line[0]);
+}
+
+struct deflate_job {
+	struct image *img;
+	const uint8_t *data;
+	size_t len;
+	size_t block_size;
+	int finish;
+};
+
+static void deflate_job_blocks(void *arg, unsigned int first, unsigned int num)
+{
+	struct deflate_job *j = arg;
+	struct image *img = j->img;
+	unsigned int i;
+
+	for (i = first; i < first + num; i++) {
+		struct png_block *b = &img->blocks[i];
+		size_t offset = i * j->block_size;
+		size_t len = j->len - offset;
+		size_t dict = offset + img->history;
+		int last = i == (j->len ? (j->len - 1) / j->block_size : 0);
+		z_stream z;
+		int ret;
+
+		if (len > j->block_size)
+			len = j->block_size;
+		if (dict > PNG_WINDOW)
+			dict = PNG_WINDOW;
+
+		memset(&z, 0, sizeof(z));
+		b->err = 1;
+		if (deflateInit2(&z, Z_BEST_SPEED, Z_DEFLATED, -15, 8,
+				 Z_DEFAULT_STRATEGY) != Z_OK)
+			continue;
+
+		if (dict)
+			deflateSetDictionary(&z, j->data + offset - dict, dict);
+
+		z.next_in = (Bytef *)j->data + offset;
+		z.avail_in = len;
+		z.next_out = b->out;
+		z.avail_out = b->out_alloc;
+		ret = deflate(&z, last && j->finish ? Z_FINISH : Z_SYNC_FLUSH);
+		if (z.avail_in == 0 &&
+		    ret == (last && j->finish ? Z_STREAM_END : Z_OK)) {
+			b->out_len = b->out_alloc - z.avail_out;
+			b->adler = adler32(1, j->data + offset, len);
+			b->err = 0;
+		}
+		deflateEnd(&z);
+	}
+}
+
+/*
+ * Deflate @len bytes at @data, which is preceded by img->history bytes
+ * of earlier data, and write them out as one IDAT chunk.
+ */
+static int png_deflate(struct image *img, const uint8_t *data, size_t len,
+	int finish)
+{
+	struct deflate_job j = {
+		.img = img,
+		.data = data,
+		.len = len,
+		.block_size = CHUNK_BYTES,
+		.finish = finish,
+	};
+	unsigned int i, n, nr = len ? (len + j.block_size - 1) / j.block_size : 1;
+	const void **piece;
+	size_t *piece_len;
+	uint8_t zhdr[2] = { 0x78, 0x01 }, trailer[4];
+	int ret;
+
+	if (nr > img->nr_blocks) {
+		struct png_block *b = realloc(img->blocks, nr * sizeof(*b));
+
+		if (!b)
+			return -1;
+		memset(b + img->nr_blocks, 0,
+		       (nr - img->nr_blocks) * sizeof(*b));
+		img->blocks = b;
+		img->nr_blocks = nr;
+	}
+
+	for (i = 0; i < nr; i++) {
+		struct png_block *b = &img->blocks[i];
+		/* deflateBound() of a raw stream, plus the flush markers */
+		size_t need = compressBound(j.block_size) + 16;
+
+		if (b->out_alloc < need) {
+			free(b->out);
+			b->out = malloc(need);
+			b->out_alloc = b->out ? need : 0;
+			if (!b->out)
+				return -1;
+		}
+	}
+
+	run_job(deflate_job_blocks, &j, nr, 0);
+
+	piece = malloc((nr + 2) * sizeof(*piece));
+	piece_len = malloc((nr + 2) * sizeof(*piece_len));
+	if (!piece || !piece_len) {
+		ret = -1;
+		goto out;
+	}
+
+	ret = 0;
+	n = 0;
+	if (!img->history && !img->lines) {
+		piece[n] = zhdr;
+		piece_len[n++] = sizeof(zhdr);
+	}
+	for (i = 0; i < nr; i++) {
+		struct png_block *b = &img->blocks[i];
+		size_t blen = len - i * j.block_size;
+
+		if (b->err) {
+			errno = ENOMEM;
+			ret = -1;
+			goto out;
+		}
+		if (blen > j.block_size)
+			blen = j.block_size;
+		img->adler = adler32_combine(img->adler, b->adler, blen);
+		piece[n] = b->out;
+		piece_len[n++] = b->out_len;
+	}
+	if (finish) {
+		put_be32(trailer, img->adler);
+		piece[n] = trailer;
+		piece_len[n++] = sizeof(trailer);
+		img->finished = 1;
+	}
+
+	ret = png_chunk(img, "IDAT", piece, piece_len, n);
+
+out:
+	free(piece);
+	free(piece_len);
+	return ret;
+}
+
+int image_write(struct image *img, const void *buf, unsigned int nr_lines,
+	size_t stride)
+{
+	struct convert_job j = {
+		.img = img,
+		.src = buf,
+		.stride = stride,
+	};
+	size_t size, head = 0;
+	int ret;
+
+	if (img->format == IMAGE_RAW) {
+		size = (size_t)nr_lines * stride;
+		if (img->height == IMAGE_UNBOUNDED)
+			return write_all(img->fd, buf, size);
+		if (size > img->raw_size)
+			size = img->raw_size;
+		img->raw_size -= size;
+		return write_all(img->fd, buf, size);
+	}
+
+	if (nr_lines > img->height - img->lines)
+		nr_lines = img->height - img->lines;
+	if (!nr_lines)
+		return 0;
+
+	/* PNG keeps the tail of the previous chunk in front as history */
+	if (img->format == IMAGE_PNG)
+		head = PNG_WINDOW;
+	size = head + (size_t)nr_lines * img->line_bytes;
+	if (size > img->buf_alloc) {
+		uint8_t *p = malloc(size);
+
+		if (!p)
+			return -1;
+		if (img->history)
+			memcpy(p + head - img->history,
+			       img->buf + img->buf_alloc - img->history,
+			       img->history);
+		free(img->buf);
+		img->buf = p;
+		img->buf_alloc = size;
+	} else if (img->history) {
+		memmove(img->buf + head - img->history,
+			img->buf + img->buf_alloc - img->history,
+			img->history);
+	}
+	j.dst = img->buf + head;
+
+	run_job(convert_job_lines, &j, nr_lines, img->line_bytes);
+	if (img->err) {
+		errno = img->err;
+		return -1;
+	}
+
+	size -= head;
+	if (img->format != IMAGE_PNG) {
+		img->lines += nr_lines;
+		return write_all(img->fd, j.dst, size);
+	}
+
+	ret = png_deflate(img, j.dst, size,
+			  img->lines + nr_lines == img->height);
+	img->lines += nr_lines;
+
+	/* Move the history to the end of the buffer for the next call */
+	memcpy(img->prev, (const uint8_t *)buf + (nr_lines - 1) * stride,
+	       (size_t)img->width * img->cpp);
+	if (size >= PNG_WINDOW) {
+		img->history = PNG_WINDOW;
+	} else {
+		img->history += size;
+		if (img->history > PNG_WINDOW)
+			img->history = PNG_WINDOW;
+	}
+	memmove(img->buf + img->buf_alloc - img->history,
+		j.dst + size - img->history, img->history);
+
+	return ret;
+}
+
+/* Lines not written are filled with zeroes */
+int image_close(struct image *img)
+{
+	static const uint8_t zero[4096];
+	int ret = 0;
+
+	if (img->format == IMAGE_RAW) {
+		while (!ret && img->raw_size) {
+			size_t n = img->raw_size;
+
+			if (n > sizeof(zero))
+				n = sizeof(zero);
+			ret = image_write(img, zero, 1, n);
+		}
+	} else {
+		size_t stride = (size_t)img->width * img->cpp;
+		uint8_t *line = calloc(1, stride);
+
+		if (!line)
+			ret = -1;
+		while (!ret && img->lines < img->height)
+			ret = image_write(img, line, 1, stride);
+		free(line);
+
+		if (!ret && img->format == IMAGE_PNG && !img->finished)
+			ret = png_deflate(img, NULL, 0, 1);
+		if (!ret && img->format == IMAGE_PNG)
+			ret = png_chunk(img, "IEND", NULL, NULL, 0);
+	}
+
+	if (img->blocks)
+		while (img->nr_blocks--)
+			free(img->blocks[img->nr_blocks].out);
+	free(img->blocks);
+	free(img->buf);
+	free(img->prev);
+	free(img);
+
+	return ret;
+}
@@ -0,0 +1,48 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+enum image_format {
+	IMAGE_RAW,
+	IMAGE_PPM,
+	IMAGE_PAM,
+	IMAGE_PNG,
+};
+
+/* How source pixels are read, for the image formats */
+enum image_pixel {
+	PIXEL_RGBX8,		/* byte 0 red, as bin2img reads it */
+	PIXEL_GREY8,
+	PIXEL_X4R4G4B4,
+	PIXEL_A4R4G4B4,
+	PIXEL_X1R5G5B5,
+	PIXEL_A1R5G5B5,
+	PIXEL_R5G6B5,
+	PIXEL_X8R8G8B8,
+	PIXEL_A8R8G8B8,
+	PIXEL_D16,
+	PIXEL_D24S8,
+};
+
+/* Height of a raw image whose end is only known at the end of input */
+#define IMAGE_UNBOUNDED	(~0u)
+
+struct image;
+
+int image_format(const char *name);
+unsigned int image_pixel_size(enum image_pixel pixel);
+struct image *image_open(int fd, enum image_format format, unsigned int width,
+	unsigned int height, unsigned int cpp);
+struct image *image_open_pixel(int fd, enum image_format format,
+	unsigned int width, unsigned int height, enum image_pixel pixel);
+int image_write(struct image *img, const void *buf, unsigned int nr_lines,
+	size_t stride);
+int image_close(struct image *img);
+
+/* Read or write @size bytes, short only at the end of input or on error */
+ssize_t safe_read(int fd, void *buf, size_t size);
+ssize_t safe_write(int fd, const void *buf, size_t size);
+
+#endif
@@ -0,0 +1,124 @@
+#include <pthread.h>
+#include <unistd.h>
+
+#include "job.h"
+
+unsigned int nr_threads = 1;
+
+struct job {
+	void (*fn)(void *arg, unsigned int first, unsigned int num);
+	void *arg;
+	unsigned int nr_rows;
+	unsigned int chunk;
+	unsigned int next;
+};
+
+/*
+ * The workers are started on the first job and then kept for the rest
+ * of the run: streaming issues a job per chunk, and creating threads
+ * for each of those would cost more than the chunk itself.  Every
+ * worker joins every job; @seq tells them a new one was posted and
+ * @active counts those still working on it.  A job run from within a
+ * job, such as detiling one of several surfaces processed in parallel,
+ * runs on the calling thread.
+ */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct job *job;
+	unsigned long seq;
+	unsigned int active;
+	unsigned int nr_workers;
+} pool = {
+	.lock = PTHREAD_MUTEX_INITIALIZER,
+	.cond = PTHREAD_COND_INITIALIZER,
+};
+
+static __thread int in_job;
+
+static void job_worker(struct job *job)
+{
+	unsigned int first;
+
+	while ((first = __atomic_fetch_add(&job->next, job->chunk,
+					   __ATOMIC_RELAXED)) < job->nr_rows) {
+		unsigned int num = job->nr_rows - first;
+
+		job->fn(job->arg, first, num < job->chunk ? num : job->chunk);
+	}
+}
+
+static void *pool_worker(void *data)
+{
+	unsigned long seq = 0;
+	struct job *job;
+
+	in_job = 1;
+	pthread_mutex_lock(&pool.lock);
+	for (;;) {
+		while (pool.seq == seq)
+			pthread_cond_wait(&pool.cond, &pool.lock);
+		seq = pool.seq;
+		job = pool.job;
+		pthread_mutex_unlock(&pool.lock);
+
+		job_worker(job);
+
+		pthread_mutex_lock(&pool.lock);
+		if (--pool.active == 0)
+			pthread_cond_broadcast(&pool.cond);
+	}
+
+	return NULL;
+}
+
+/* 0 selects one thread per online CPU */
+void job_set_threads(unsigned int n)
+{
+	if (n == 0)
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	if (n > MAX_THREADS)
+		n = MAX_THREADS;
+	nr_threads = n ? n : 1;
+}
+
+void run_job(void (*fn)(void *, unsigned int, unsigned int),
+	void *arg, unsigned int nr_rows, size_t row_bytes)
+{
+	struct job job = {
+		.fn = fn,
+		.arg = arg,
+		.nr_rows = nr_rows,
+	};
+	pthread_t thread;
+
+	job.chunk = row_bytes ? CHUNK_BYTES / row_bytes : 1;
+	if (job.chunk == 0)
+		job.chunk = 1;
+
+	if (in_job || nr_threads == 1 || nr_rows <= job.chunk) {
+		job_worker(&job);
+		return;
+	}
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.nr_workers < nr_threads - 1 &&
+	       pthread_create(&thread, NULL, pool_worker, NULL) == 0) {
+		pthread_detach(thread);
+		pool.nr_workers++;
+	}
+	pool.job = &job;
+	pool.active = pool.nr_workers;
+	pool.seq++;
+	pthread_cond_broadcast(&pool.cond);
+	pthread_mutex_unlock(&pool.lock);
+
+	in_job = 1;
+	job_worker(&job);
+	in_job = 0;
+
+	pthread_mutex_lock(&pool.lock);
+	while (pool.active)
+		pthread_cond_wait(&pool.cond, &pool.lock);
+	pthread_mutex_unlock(&pool.lock);
+}
@@ -0,0 +1,22 @@
+#ifndef JOB_H
+#define JOB_H
+
+#include <stddef.h>
+
+/*
+ * Work is split into chunks of whole rows, which the worker threads
+ * pull from a shared counter.  Chunks are sized to stay within the L2 of
+ * one core, so the source and destination rows stay cache resident.
+ */
+enum {
+	CHUNK_BYTES = 256 * 1024,
+	MAX_THREADS = 64,
+};
+
+extern unsigned int nr_threads;
+
+void job_set_threads(unsigned int n);
+void run_job(void (*fn)(void *arg, unsigned int first, unsigned int num),
+	void *arg, unsigned int nr_rows, size_t row_bytes);
+
+#endif
@@ -0,0 +1,831 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * SSE2 kernels are built when the target has SSE2.  Later extensions are
+ * built with a target attribute and picked at run time.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "image.h"
+#include "job.h"
+#include "tile.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+static uint8_t supertile_swizzle[16][16];
+
+static void supertile_init(void)
+{
+	unsigned int x, y, i;
+
+	for (y = 0; y < 16; y++)
+		for (x = 0; x < 16; x++)
+			for (i = 0; i < 4; i++)
+				supertile_swizzle[y][x] |=
+					((x >> i) & 1) << (2 * i) |
+					((y >> i) & 1) << (2 * i + 1);
+}
+
+static uint32_t layout_tile(const struct layout *l, unsigned int row,
+	unsigned int col)
+{
+	unsigned int half = 0;
+	uint32_t idx;
+
+	if (l->flags & LAYOUT_MULTI) {
+		half = (row & 1) ^ ((col >> 1) & 1);
+		col = (col & ~2) | (row & 1) << 1;
+		row >>= 1;
+	}
+
+	if (l->flags & LAYOUT_SUPER)
+		idx = (row & ~15) * l->src_blocks_x + (col & ~15) * 16 +
+		      supertile_swizzle[row & 15][col & 15];
+	else
+		idx = row * l->src_blocks_x + col;
+
+	return idx | (half ? LUT_HALF : 0);
+}
+
+static unsigned int align(unsigned int v, unsigned int a)
+{
+	return (v + a - 1) & ~(a - 1);
+}
+
+int layout_init(struct layout *l, unsigned int flags, unsigned int ps,
+	unsigned int width, unsigned int height)
+{
+	unsigned int align_x = 1, align_y = 1, row, p;
+
+	if (flags & LAYOUT_MULTI) {
+		align_x = 4;
+		align_y = 2;
+	}
+	if (flags & LAYOUT_SUPER) {
+		align_x = 16;
+		align_y *= 16;
+	}
+
+	l->flags = flags;
+	l->ps = ps;
+	l->blocks_x = width / 4;
+	l->blocks_y = height / 4;
+	l->src_blocks_x = align(l->blocks_x, align_x);
+	l->src_blocks_y = align(l->blocks_y, align_y);
+	l->pairs = (l->blocks_x + 1) / 2;
+	l->period = align_y;
+	l->period_tiles = (size_t)l->src_blocks_x *
+			  (flags & LAYOUT_SUPER ? 16 : 1);
+	l->src_size = (size_t)l->src_blocks_x * l->src_blocks_y * 16 * ps;
+	l->half_size = flags & LAYOUT_MULTI ? l->src_size / 2 : 0;
+
+	l->lut = malloc(sizeof(*l->lut) * l->pairs * l->period);
+	if (!l->lut)
+		return -1;
+
+	for (row = 0; row < l->period; row++)
+		for (p = 0; p < l->pairs; p++)
+			l->lut[row * l->pairs + p] = layout_tile(l, row, 2 * p);
+
+	return 0;
+}
+
+void layout_fini(struct layout *l)
+{
+	free(l->lut);
+	l->lut = NULL;
+}
+
+/* Index of linear tile (@x, @y) within the surface as laid out in memory */
+size_t layout_tile_index(const struct layout *l, unsigned int x,
+	unsigned int y)
+{
+	uint32_t e = l->lut[(y % l->period) * l->pairs + x / 2];
+	size_t idx = (y / l->period) * l->period_tiles + (e & ~LUT_HALF) +
+		     (x & 1);
+
+	if (e & LUT_HALF)
+		idx += l->half_size / (16 * l->ps);
+
+	return idx;
+}
+
+/*
+ * Row kernels.  Each detile call produces one row of @blocks_x tiles,
+ * four lines of pixels @stride bytes apart, in @dst.  Tile t comes from
+ * the @src half selected by LUT_HALF in @lut[t / 2], plus the remaining
+ * bits of that entry in tiles, plus one if t is odd.  The tile kernels
+ * do the reverse, scattering a row of tiles from @src into @dst.
+ *
+ * There are kernels specialised for each common pixel size, and with
+ * 4-byte pixels a tile is four 16-byte lines, so each line maps onto one
+ * vector load and store.  Other pixel sizes use the generic kernels.
+ */
+typedef void (*detile_row_fn)(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x);
+typedef void (*tile_row_fn)(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x);
+
+static inline const void *tile_src(const void *const *src,
+	const uint32_t *lut, unsigned int t, size_t tile_bytes)
+{
+	uint32_t e = lut[t >> 1];
+
+	return src[e >> 31] + ((e & ~LUT_HALF) + (t & 1)) * tile_bytes;
+}
+
+static inline void *tile_dst(void *const *dst, const uint32_t *lut,
+	unsigned int t, size_t tile_bytes)
+{
+	uint32_t e = lut[t >> 1];
+
+	return dst[e >> 31] + ((e & ~LUT_HALF) + (t & 1)) * tile_bytes;
+}
+
+/*
+ * Plain C kernels, written for any pixel size but always inlined, so the
+ * wrappers below get fixed-size line copies for each supported format.
+ */
+static inline __attribute__((always_inline))
+void detile_row_4x4_n(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x, unsigned int ps)
+{
+	size_t line = 4 * ps;
+	unsigned int t;
+
+	for (t = 0; t < blocks_x; t++, dst += line) {
+		const void *s = tile_src(src, lut, t, 4 * line);
+
+		memcpy(dst + 0 * stride, s + 0 * line, line);
+		memcpy(dst + 1 * stride, s + 1 * line, line);
+		memcpy(dst + 2 * stride, s + 2 * line, line);
+		memcpy(dst + 3 * stride, s + 3 * line, line);
+	}
+}
+
+static inline __attribute__((always_inline))
+void tile_row_4x4_n(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x, unsigned int ps)
+{
+	size_t line = 4 * ps;
+	unsigned int t;
+
+	for (t = 0; t < blocks_x; t++, src += line) {
+		void *d = tile_dst(dst, lut, t, 4 * line);
+
+		memcpy(d + 0 * line, src + 0 * stride, line);
+		memcpy(d + 1 * line, src + 1 * stride, line);
+		memcpy(d + 2 * line, src + 2 * stride, line);
+		memcpy(d + 3 * line, src + 3 * stride, line);
+	}
+}
+
+static void detile_row_4x4_gen(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x, unsigned int ps)
+{
+	detile_row_4x4_n(dst, stride, src, lut, blocks_x, ps);
+}
+
+static void tile_row_4x4_gen(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x, unsigned int ps)
+{
+	tile_row_4x4_n(dst, src, stride, lut, blocks_x, ps);
+}
+
+#define ROW_KERNELS(ps)							\
+static void detile_row_4x4_##ps##b(void *dst, size_t stride,		\
+	const void *const *src, const uint32_t *lut, unsigned int blocks_x) \
+{									\
+	detile_row_4x4_n(dst, stride, src, lut, blocks_x, ps);		\
+}									\
+static void tile_row_4x4_##ps##b(void *const *dst, const void *src,	\
+	size_t stride, const uint32_t *lut, unsigned int blocks_x)	\
+{									\
+	tile_row_4x4_n(dst, src, stride, lut, blocks_x, ps);		\
+}
+
+ROW_KERNELS(1)		/* A8, L8 */
+ROW_KERNELS(2)		/* RGB565, A1RGB5, A4RGB4 */
+ROW_KERNELS(4)		/* RGBA8, D24S8 */
+ROW_KERNELS(8)		/* RGBA16F */
+ROW_KERNELS(16)		/* RGBA32F */
+#undef ROW_KERNELS
+
+#if defined(__SSE2__)
+static void detile_row_4x4_sse2(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x)
+{
+	unsigned int t;
+
+	for (t = 0; t < blocks_x; t++, dst += 16) {
+		const __m128i *s = tile_src(src, lut, t, 64);
+		__m128i r0 = _mm_loadu_si128(s + 0);
+		__m128i r1 = _mm_loadu_si128(s + 1);
+		__m128i r2 = _mm_loadu_si128(s + 2);
+		__m128i r3 = _mm_loadu_si128(s + 3);
+
+		_mm_storeu_si128(dst + 0 * stride, r0);
+		_mm_storeu_si128(dst + 1 * stride, r1);
+		_mm_storeu_si128(dst + 2 * stride, r2);
+		_mm_storeu_si128(dst + 3 * stride, r3);
+	}
+}
+
+static void tile_row_4x4_sse2(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x)
+{
+	unsigned int t;
+
+	for (t = 0; t < blocks_x; t++, src += 16) {
+		__m128i *d = tile_dst(dst, lut, t, 64);
+		__m128i r0 = _mm_loadu_si128(src + 0 * stride);
+		__m128i r1 = _mm_loadu_si128(src + 1 * stride);
+		__m128i r2 = _mm_loadu_si128(src + 2 * stride);
+		__m128i r3 = _mm_loadu_si128(src + 3 * stride);
+
+		_mm_storeu_si128(d + 0, r0);
+		_mm_storeu_si128(d + 1, r1);
+		_mm_storeu_si128(d + 2, r2);
+		_mm_storeu_si128(d + 3, r3);
+	}
+}
+#endif
+
+#if defined(HAVE_X86_SIMD)
+/*
+ * One pair at a time: swap the middle 128-bit lanes of their line pairs.
+ * The same shuffle converts in both directions.
+ */
+__attribute__((target("avx2")))
+static void detile_row_4x4_avx2(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x)
+{
+	unsigned int t;
+
+	for (t = 0; t + 2 <= blocks_x; t += 2, dst += 32) {
+		const __m256i *s = tile_src(src, lut, t, 64);
+		__m256i a01 = _mm256_loadu_si256(s + 0);
+		__m256i a23 = _mm256_loadu_si256(s + 1);
+		__m256i b01 = _mm256_loadu_si256(s + 2);
+		__m256i b23 = _mm256_loadu_si256(s + 3);
+
+		_mm256_storeu_si256(dst + 0 * stride,
+			_mm256_permute2x128_si256(a01, b01, 0x20));
+		_mm256_storeu_si256(dst + 1 * stride,
+			_mm256_permute2x128_si256(a01, b01, 0x31));
+		_mm256_storeu_si256(dst + 2 * stride,
+			_mm256_permute2x128_si256(a23, b23, 0x20));
+		_mm256_storeu_si256(dst + 3 * stride,
+			_mm256_permute2x128_si256(a23, b23, 0x31));
+	}
+	if (t < blocks_x) {
+		const __m128i *s = tile_src(src, lut, t, 64);
+
+		_mm_storeu_si128(dst + 0 * stride, _mm_loadu_si128(s + 0));
+		_mm_storeu_si128(dst + 1 * stride, _mm_loadu_si128(s + 1));
+		_mm_storeu_si128(dst + 2 * stride, _mm_loadu_si128(s + 2));
+		_mm_storeu_si128(dst + 3 * stride, _mm_loadu_si128(s + 3));
+	}
+}
+
+__attribute__((target("avx2")))
+static void tile_row_4x4_avx2(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x)
+{
+	unsigned int t;
+
+	for (t = 0; t + 2 <= blocks_x; t += 2, src += 32) {
+		__m256i *d = tile_dst(dst, lut, t, 64);
+		__m256i l0 = _mm256_loadu_si256(src + 0 * stride);
+		__m256i l1 = _mm256_loadu_si256(src + 1 * stride);
+		__m256i l2 = _mm256_loadu_si256(src + 2 * stride);
+		__m256i l3 = _mm256_loadu_si256(src + 3 * stride);
+
+		_mm256_storeu_si256(d + 0, _mm256_permute2x128_si256(l0, l1, 0x20));
+		_mm256_storeu_si256(d + 1, _mm256_permute2x128_si256(l2, l3, 0x20));
+		_mm256_storeu_si256(d + 2, _mm256_permute2x128_si256(l0, l1, 0x31));
+		_mm256_storeu_si256(d + 3, _mm256_permute2x128_si256(l2, l3, 0x31));
+	}
+	if (t < blocks_x) {
+		__m128i *d = tile_dst(dst, lut, t, 64);
+
+		_mm_storeu_si128(d + 0, _mm_loadu_si128(src + 0 * stride));
+		_mm_storeu_si128(d + 1, _mm_loadu_si128(src + 1 * stride));
+		_mm_storeu_si128(d + 2, _mm_loadu_si128(src + 2 * stride));
+		_mm_storeu_si128(d + 3, _mm_loadu_si128(src + 3 * stride));
+	}
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void detile_row_4x4_neon(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x)
+{
+	unsigned int t;
+
+	for (t = 0; t < blocks_x; t++, dst += 16) {
+		const uint8_t *s = tile_src(src, lut, t, 64);
+		uint8x16_t r0 = vld1q_u8(s + 0);
+		uint8x16_t r1 = vld1q_u8(s + 16);
+		uint8x16_t r2 = vld1q_u8(s + 32);
+		uint8x16_t r3 = vld1q_u8(s + 48);
+
+		vst1q_u8(dst + 0 * stride, r0);
+		vst1q_u8(dst + 1 * stride, r1);
+		vst1q_u8(dst + 2 * stride, r2);
+		vst1q_u8(dst + 3 * stride, r3);
+	}
+}
+
+static void tile_row_4x4_neon(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x)
+{
+	unsigned int t;
+
+	for (t = 0; t < blocks_x; t++, src += 16) {
+		uint8_t *d = tile_dst(dst, lut, t, 64);
+		uint8x16_t r0 = vld1q_u8(src + 0 * stride);
+		uint8x16_t r1 = vld1q_u8(src + 1 * stride);
+		uint8x16_t r2 = vld1q_u8(src + 2 * stride);
+		uint8x16_t r3 = vld1q_u8(src + 3 * stride);
+
+		vst1q_u8(d + 0, r0);
+		vst1q_u8(d + 16, r1);
+		vst1q_u8(d + 32, r2);
+		vst1q_u8(d + 48, r3);
+	}
+}
+#endif
+
+/*
+ * MSAA line kernels.  Each produces @n pixels from the sample pairs of
+ * @s0, and for 4x of @s1 as well.  The box resolve rounds to nearest.
+ */
+typedef void (*resolve_line_fn)(void *dst, const uint8_t *s0,
+	const uint8_t *s1, unsigned int n);
+
+static void resolve_line_gen(void *dst, const uint8_t *s0, const uint8_t *s1,
+	unsigned int n, unsigned int ps)
+{
+	unsigned int count = s1 ? 4 : 2, i, sum;
+	uint8_t *d = dst;
+
+	for (i = 0; i < n * ps; i++) {
+		unsigned int x = i / ps * 2 * ps + i % ps;
+
+		sum = s0[x] + s0[x + ps];
+		if (s1)
+			sum += s1[x] + s1[x + ps];
+		d[i] = (sum + count / 2) / count;
+	}
+}
+
+static void resolve_line_4b(void *dst, const uint8_t *s0, const uint8_t *s1,
+	unsigned int n)
+{
+	resolve_line_gen(dst, s0, s1, n, 4);
+}
+
+#if defined(__SSE2__)
+/* Four pixels at a time, de-interleaving the sample pairs with shufps */
+static void resolve_line_4b_sse2(void *dst, const uint8_t *s0,
+	const uint8_t *s1, unsigned int n)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(s1 ? 2 : 1);
+	const __m128i shift = _mm_cvtsi32_si128(s1 ? 2 : 1);
+	unsigned int x;
+
+	for (x = 0; x + 4 <= n; x += 4, dst += 16) {
+		__m128i lo = round, hi = round;
+		const uint8_t *s;
+
+		for (s = s0; s; s = s == s0 ? s1 : NULL) {
+			__m128 a = _mm_castsi128_ps(
+				_mm_loadu_si128((const __m128i *)(s + 8 * x)));
+			__m128 b = _mm_castsi128_ps(
+				_mm_loadu_si128((const __m128i *)(s + 8 * x + 16)));
+			__m128i e = _mm_castps_si128(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+			__m128i o = _mm_castps_si128(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+
+			lo = _mm_add_epi16(lo, _mm_add_epi16(
+				_mm_unpacklo_epi8(e, zero),
+				_mm_unpacklo_epi8(o, zero)));
+			hi = _mm_add_epi16(hi, _mm_add_epi16(
+				_mm_unpackhi_epi8(e, zero),
+				_mm_unpackhi_epi8(o, zero)));
+		}
+
+		_mm_storeu_si128(dst, _mm_packus_epi16(_mm_srl_epi16(lo, shift),
+						       _mm_srl_epi16(hi, shift)));
+	}
+
+	if (x < n)
+		resolve_line_gen(dst, s0 + 8 * x, s1 ? s1 + 8 * x : NULL,
+				 n - x, 4);
+}
+#endif
+
+#if defined(__ARM_NEON)
+static void resolve_line_4b_neon(void *dst, const uint8_t *s0,
+	const uint8_t *s1, unsigned int n)
+{
+	unsigned int x;
+
+	for (x = 0; x + 4 <= n; x += 4, dst += 16) {
+		uint32x4x2_t a = vld2q_u32((const uint32_t *)(s0 + 8 * x));
+		uint8x16_t e = vreinterpretq_u8_u32(a.val[0]);
+		uint8x16_t o = vreinterpretq_u8_u32(a.val[1]);
+		uint16x8_t lo = vaddl_u8(vget_low_u8(e), vget_low_u8(o));
+		uint16x8_t hi = vaddl_u8(vget_high_u8(e), vget_high_u8(o));
+
+		if (s1) {
+			a = vld2q_u32((const uint32_t *)(s1 + 8 * x));
+			e = vreinterpretq_u8_u32(a.val[0]);
+			o = vreinterpretq_u8_u32(a.val[1]);
+			lo = vaddq_u16(lo, vaddl_u8(vget_low_u8(e),
+						    vget_low_u8(o)));
+			hi = vaddq_u16(hi, vaddl_u8(vget_high_u8(e),
+						    vget_high_u8(o)));
+			vst1q_u8(dst, vcombine_u8(vrshrn_n_u16(lo, 2),
+						  vrshrn_n_u16(hi, 2)));
+		} else {
+			vst1q_u8(dst, vcombine_u8(vrshrn_n_u16(lo, 1),
+						  vrshrn_n_u16(hi, 1)));
+		}
+	}
+
+	if (x < n)
+		resolve_line_gen(dst, s0 + 8 * x, s1 ? s1 + 8 * x : NULL,
+				 n - x, 4);
+}
+#endif
+
+static resolve_line_fn resolve_line = resolve_line_4b;
+
+/*
+ * Reduce the four lines of a detiled row of tiles at @src, @stride bytes
+ * apart, to the lines of @dst, @dst_stride bytes apart.
+ */
+static void msaa_row(void *dst, size_t dst_stride, const uint8_t *src,
+	size_t stride, const struct msaa *msaa, unsigned int n,
+	unsigned int ps)
+{
+	unsigned int ys = msaa->samples == 4 ? 2 : 1, y, x;
+
+	for (y = 0; y < 4 / ys; y++, dst += dst_stride) {
+		const uint8_t *s0 = src + y * ys * stride;
+		const uint8_t *s1 = ys == 2 ? s0 + stride : NULL;
+
+		if (msaa->sample >= 0) {
+			s0 += (msaa->sample & 1) * ps +
+			      (ys == 2 ? (msaa->sample >> 1) * stride : 0);
+			for (x = 0; x < n; x++)
+				memcpy(dst + x * ps, s0 + 2 * x * ps, ps);
+		} else if (ps == 4) {
+			resolve_line(dst, s0, s1, n);
+		} else {
+			resolve_line_gen(dst, s0, s1, n, ps);
+		}
+	}
+}
+
+/* Indexed by bytes per pixel */
+static detile_row_fn detile_row_4x4[17];
+static tile_row_fn tile_row_4x4[17];
+
+void detile_init(void)
+{
+	supertile_init();
+
+	detile_row_4x4[1] = detile_row_4x4_1b;
+	detile_row_4x4[2] = detile_row_4x4_2b;
+	detile_row_4x4[4] = detile_row_4x4_4b;
+	detile_row_4x4[8] = detile_row_4x4_8b;
+	detile_row_4x4[16] = detile_row_4x4_16b;
+	tile_row_4x4[1] = tile_row_4x4_1b;
+	tile_row_4x4[2] = tile_row_4x4_2b;
+	tile_row_4x4[4] = tile_row_4x4_4b;
+	tile_row_4x4[8] = tile_row_4x4_8b;
+	tile_row_4x4[16] = tile_row_4x4_16b;
+#if defined(__SSE2__)
+	detile_row_4x4[4] = detile_row_4x4_sse2;
+	tile_row_4x4[4] = tile_row_4x4_sse2;
+	resolve_line = resolve_line_4b_sse2;
+#endif
+#if defined(HAVE_X86_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		detile_row_4x4[4] = detile_row_4x4_avx2;
+		tile_row_4x4[4] = tile_row_4x4_avx2;
+	}
+#endif
+#if defined(__ARM_NEON)
+	detile_row_4x4[4] = detile_row_4x4_neon;
+	tile_row_4x4[4] = tile_row_4x4_neon;
+	resolve_line = resolve_line_4b_neon;
+#endif
+}
+
+static void detile_row(void *dst, size_t stride, const void *const *src,
+	const uint32_t *lut, unsigned int blocks_x, unsigned int ps)
+{
+	if (ps < ARRAY_SIZE(detile_row_4x4) && detile_row_4x4[ps])
+		detile_row_4x4[ps](dst, stride, src, lut, blocks_x);
+	else
+		detile_row_4x4_gen(dst, stride, src, lut, blocks_x, ps);
+}
+
+static void tile_row(void *const *dst, const void *src, size_t stride,
+	const uint32_t *lut, unsigned int blocks_x, unsigned int ps)
+{
+	if (ps < ARRAY_SIZE(tile_row_4x4) && tile_row_4x4[ps])
+		tile_row_4x4[ps](dst, src, stride, lut, blocks_x);
+	else
+		tile_row_4x4_gen(dst, src, stride, lut, blocks_x, ps);
+}
+
+static int tile_status_cleared(const struct tile_status *ts, size_t offset)
+{
+	size_t bit = offset / ts->entry_bytes * ts->bits;
+
+	if (bit / 8 >= ts->size)
+		return 0;
+
+	return (ts->buf[bit / 8] >> (bit % 8) & ((1 << ts->bits) - 1)) ==
+	       TS_CLEARED;
+}
+
+/*
+ * A clear value wider than 32 bits is taken as a 64-bit pattern,
+ * otherwise the 32-bit value is repeated, as the hardware does for 16
+ * and 32 bits per pixel formats.
+ */
+void tile_status_init(struct tile_status *ts, const void *buf, size_t size,
+	unsigned int bits, uint64_t clear)
+{
+	unsigned int i, n = clear >> 32 ? 8 : 4;
+
+	ts->buf = buf;
+	ts->size = size;
+	ts->bits = bits;
+	ts->entry_bytes = bits == 2 ? 64 : 128;
+	for (i = 0; i < sizeof(ts->clear); i++)
+		ts->clear[i] = clear >> (i % n * 8);
+}
+
+/*
+ * Overwrite the lines of a detiled row of tiles whose tile status says
+ * cleared.  @pos is the offset within each half of the surface that the
+ * entries of @lut are relative to.
+ */
+static void fill_cleared(void *dst, size_t stride,
+	const struct tile_status *ts, const struct layout *l,
+	const uint32_t *lut, size_t pos)
+{
+	size_t tile_bytes = 16 * l->ps, line_bytes = 4 * l->ps;
+	unsigned int t, y;
+
+	for (t = 0; t < l->blocks_x; t++) {
+		uint32_t e = lut[t / 2];
+		size_t offset = (e >> 31) * l->half_size + pos +
+				((e & ~LUT_HALF) + (t & 1)) * tile_bytes;
+
+		for (y = 0; y < 4; y++)
+			if (tile_status_cleared(ts, offset + y * line_bytes))
+				memcpy(dst + y * stride + t * line_bytes,
+				       ts->clear, line_bytes);
+	}
+}
+
+/*
+ * Rows are relative to @tiled, which points at the start of a period in
+ * each half of the surface, and to @linear and @resolved.
+ */
+struct detile_job {
+	void *linear;
+	void *tiled[2];
+	const struct layout *l;
+	const struct tile_status *ts;
+	const struct msaa *msaa;
+	void *resolved;
+	size_t pos;		/* of @tiled within each half */
+};
+
+static void detile_job_rows(void *arg, unsigned int first, unsigned int num)
+{
+	struct detile_job *j = arg;
+	const struct layout *l = j->l;
+	size_t tile_bytes = 16 * l->ps;
+	size_t stride = 4 * l->ps * l->blocks_x;
+	unsigned int lines = j->msaa && j->msaa->samples == 4 ? 2 : 4;
+	unsigned int row;
+
+	for (row = first; row < first + num; row++) {
+		const uint32_t *lut = l->lut + (row % l->period) * l->pairs;
+		size_t offset = (row / l->period) * l->period_tiles * tile_bytes;
+		const void *src[2] = {
+			j->tiled[0] + offset,
+			j->tiled[1] + offset,
+		};
+
+		detile_row(j->linear + row * 4 * stride, stride, src, lut,
+			   l->blocks_x, l->ps);
+		if (j->ts)
+			fill_cleared(j->linear + row * 4 * stride, stride,
+				     j->ts, l, lut, j->pos + offset);
+		if (j->msaa)
+			msaa_row(j->resolved + row * lines * (stride / 2),
+				 stride / 2, j->linear + row * 4 * stride,
+				 stride, j->msaa, l->blocks_x * 2, l->ps);
+	}
+}
+
+static void tile_job_rows(void *arg, unsigned int first, unsigned int num)
+{
+	struct detile_job *j = arg;
+	const struct layout *l = j->l;
+	size_t tile_bytes = 16 * l->ps;
+	size_t stride = 4 * l->ps * l->blocks_x;
+	unsigned int row;
+
+	for (row = first; row < first + num; row++) {
+		const uint32_t *lut = l->lut + (row % l->period) * l->pairs;
+		size_t offset = (row / l->period) * l->period_tiles * tile_bytes;
+		void *dst[2] = {
+			j->tiled[0] + offset,
+			j->tiled[1] + offset,
+		};
+
+		tile_row(dst, j->linear + row * 4 * stride, stride, lut,
+			 l->blocks_x, l->ps);
+	}
+}
+
+void detile(void *dst, const void *src, const struct layout *l)
+{
+	struct detile_job j = {
+		.linear = dst,
+		.tiled = { (void *)src, (void *)src + l->half_size },
+		.l = l,
+	};
+
+	run_job(detile_job_rows, &j, l->blocks_y,
+		(size_t)16 * l->ps * l->blocks_x);
+}
+
+/* Padding tiles of @dst, if any, are left untouched */
+void tile(void *dst, const void *src, const struct layout *l)
+{
+	struct detile_job j = {
+		.linear = (void *)src,
+		.tiled = { dst, dst + l->half_size },
+		.l = l,
+	};
+
+	run_job(tile_job_rows, &j, l->blocks_y,
+		(size_t)16 * l->ps * l->blocks_x);
+}
+
+/* Get up to @size bytes, read into @buf unless the input is mapped */
+static ssize_t input_get(struct input *in, void *buf, size_t size,
+	const void **data)
+{
+	ssize_t rd;
+
+	if (!in->map) {
+		*data = buf;
+		rd = safe_read(in->fd, buf, size);
+		if (rd > 0)
+			in->bytes += rd;
+		return rd;
+	}
+
+	if (size > in->size - in->pos)
+		size = in->size - in->pos;
+	*data = in->map + in->pos;
+	in->pos += size;
+	in->bytes += size;
+
+	return size;
+}
+
+/*
+ * Detile a few periods of tile rows at a time, handing each chunk to the
+ * output before getting the next, so neither the input nor the output is
+ * held in memory as a whole.  The multi-pipe layouts need tiles from both
+ * halves for every row, so the upper half is read up front, then the
+ * lower half is streamed against it.  With @unbounded set, the height is
+ * not known and chunks are read until the end of the input.  With @msaa,
+ * the output is the resolved rows.
+ */
+int stream_detile(struct input *in, struct image *out,
+	const struct layout *l, const struct tile_status *ts,
+	const struct msaa *msaa, int unbounded)
+{
+	size_t tile_bytes = 16 * l->ps;
+	size_t period_bytes = l->period_tiles * tile_bytes;
+	size_t stride = (size_t)l->blocks_x * 4 * l->ps;
+	size_t line_bytes = msaa ? stride / 2 : stride;
+	unsigned int lines = msaa && msaa->samples == 4 ? 2 : 4;
+	unsigned int periods, rows, row, pad = 0;
+	void *upper = NULL, *src = NULL, *dst, *resolved = NULL;
+	const void *data, *upper_data = NULL;
+	ssize_t rd;
+	int ret = -1;
+
+	periods = CHUNK_BYTES * nr_threads / period_bytes;
+	if (periods == 0)
+		periods = 1;
+
+	dst = malloc(periods * l->period * 4 * stride);
+	if (!in->map)
+		src = malloc(periods * period_bytes);
+	if (msaa)
+		resolved = malloc(periods * l->period * lines * (stride / 2));
+	if (!dst || (!in->map && !src) || (msaa && !resolved))
+		goto out;
+
+	if (l->half_size) {
+		if (!in->map) {
+			upper = malloc(l->half_size);
+			if (!upper)
+				goto out;
+		}
+		rd = input_get(in, upper, l->half_size, &upper_data);
+		if (rd < 0)
+			goto out;
+		if (rd != l->half_size)
+			goto short_read;
+	}
+
+	for (row = 0; unbounded || row < l->blocks_y; row += rows) {
+		struct detile_job j = {
+			.linear = dst,
+			.l = l,
+			.ts = ts,
+			.msaa = msaa,
+			.resolved = resolved,
+			.pos = row / l->period * period_bytes,
+		};
+		size_t src_bytes;
+
+		rows = periods * l->period;
+		if (!unbounded && rows > l->blocks_y - row)
+			rows = l->blocks_y - row;
+
+		src_bytes = (rows + l->period - 1) / l->period * period_bytes;
+		rd = input_get(in, src, src_bytes, &data);
+		if (rd < 0)
+			goto out;
+		if (rd != src_bytes) {
+			if (!unbounded)
+				goto short_read;
+			rows = rd / period_bytes * l->period;
+			/* Lines short of a period are zero, as for a mapped file */
+			pad = rd % period_bytes * lines / (4 * stride);
+		}
+
+		if (rows) {
+			j.tiled[0] = (void *)(upper_data ? upper_data + j.pos :
+					      data);
+			j.tiled[1] = (void *)data;
+			run_job(detile_job_rows, &j, rows, 4 * stride);
+			in->rows += rows;
+
+			if (image_write(out, msaa ? resolved : dst,
+					rows * lines, line_bytes))
+				goto out;
+		}
+
+		if (rd != src_bytes) {
+			memset(dst, 0, pad * line_bytes);
+			if (pad && image_write(out, dst, pad, line_bytes))
+				goto out;
+			break;
+		}
+	}
+
+	ret = 0;
+	goto out;
+short_read:
+	errno = EIO;
+out:
+	free(upper);
+	free(src);
+	free(dst);
+	free(resolved);
+	return ret;
+}
+
@@ -0,0 +1,114 @@
+#ifndef TILE_H
+#define TILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct image;
+
+/*
+ * Surface layouts.  All of them are made of 4x4 pixel tiles, and in all
+ * of them the two tiles of each horizontally adjacent, even-aligned pair
+ * are stored next to each other.  A layout is described by the source
+ * tile index of every pair in a row of tiles.  This repeats every
+ * @period rows of tiles, with the source advancing by @period_tiles.
+ *
+ * Tiled: tiles are stored in raster order.
+ *
+ * Multi-pipe: the two pixel pipes each render alternate pairs of tiles,
+ * and write them to the upper and lower half of the surface:
+ *
+ * 4  8  12 16 20 24 28 32 36  40  44  48  52  56  60  64
+ * u1 u2 l1 l2 u5 u6 l5 l6 u9  u10 l9  l10 u13 u14 l13 l14
+ * l3 l4 u3 u4 l7 l8 u7 u8 l11 l12 u11 u12 l15 l16 u15 u16
+ *
+ * Supertiled: 64x64 pixel supertiles are stored in raster order, and
+ * within each the 16x16 tiles are in Morton order, x in the low bit.
+ *
+ * Multi-pipe supertiled: as multi-pipe, but with supertiled halves.
+ *
+ * Entries for the lower half have LUT_HALF set, so the two halves need
+ * not be contiguous in memory.
+ */
+enum {
+	LAYOUT_MULTI = 1,
+	LAYOUT_SUPER = 2,
+};
+
+#define LUT_HALF	0x80000000u
+
+struct layout {
+	unsigned int flags;
+	unsigned int ps;		/* bytes per pixel */
+	unsigned int blocks_x;		/* tiles in the linear image */
+	unsigned int blocks_y;
+	unsigned int src_blocks_x;	/* tiles in the padded surface */
+	unsigned int src_blocks_y;
+	unsigned int pairs;		/* lut entries per row of tiles */
+	unsigned int period;		/* rows of tiles per lut */
+	size_t period_tiles;
+	size_t src_size;
+	size_t half_size;		/* offset of the lower half */
+	uint32_t *lut;
+};
+
+/*
+ * Fast clear.  A surface with tile status has a TS buffer alongside,
+ * holding 2 or 4 bits for each 64 or 128 bytes of the surface as laid
+ * out in memory.  Cleared entries hold TS_CLEARED, and the bytes they
+ * cover were never written: they read as the clear value, repeated.
+ * Detiled rows are patched while they are still in the cache.
+ */
+enum {
+	TS_CLEARED = 1,
+};
+
+struct tile_status {
+	const uint8_t *buf;
+	size_t size;
+	unsigned int bits;
+	unsigned int entry_bytes;
+	uint8_t clear[64];	/* one line of a tile */
+};
+
+/*
+ * Multisampled surfaces.  The samples of each pixel are stored as
+ * adjacent pixels, side by side for 2x and as a 2x2 block for 4x, so
+ * the surface is twice the width and, for 4x, twice the height of the
+ * image.  Detiled rows are reduced to one sample, or box-resolved, while
+ * they are still in the cache.  Resolving averages bytes, so it only
+ * suits formats with 8-bit channels.
+ */
+struct msaa {
+	unsigned int samples;	/* 2 or 4 */
+	int sample;		/* to extract, or -1 to resolve */
+};
+
+/*
+ * The tiled input, either mmap()ed as a whole or read from a pipe a
+ * chunk at a time.  @bytes and @rows count what stream_detile() consumed.
+ */
+struct input {
+	int fd;
+	const void *map;
+	size_t size;
+	size_t pos;
+	uint64_t bytes;
+	unsigned int rows;
+};
+
+void detile_init(void);
+int layout_init(struct layout *l, unsigned int flags, unsigned int ps,
+	unsigned int width, unsigned int height);
+void layout_fini(struct layout *l);
+size_t layout_tile_index(const struct layout *l, unsigned int x,
+	unsigned int y);
+void tile_status_init(struct tile_status *ts, const void *buf, size_t size,
+	unsigned int bits, uint64_t clear);
+void detile(void *dst, const void *src, const struct layout *l);
+void tile(void *dst, const void *src, const struct layout *l);
+int stream_detile(struct input *in, struct image *out,
+	const struct layout *l, const struct tile_status *ts,
+	const struct msaa *msaa, int unbounded);
+
+#endif
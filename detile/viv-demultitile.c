@@ -1,5 +1,6 @@
 #include <errno.h>
 #include <getopt.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,147 +9,167 @@
 #include <sys/mman.h>
 #include <unistd.h>
 
-static int safe_write(int fd, void *buf, size_t size)
+#include "image.h"
+#include "job.h"
+#include "tile.h"
+#include "yuv.h"
+#include "../stats/stats.h"
+
+/* Map a TS buffer */
+static int tile_status_open(struct tile_status *ts, const char *name,
+	unsigned int bits, uint64_t clear)
 {
-	size_t written = 0;
-	ssize_t ret = 0;
+	struct stat st;
+	void *ptr;
+	int fd;
 
-	while (size) {
-		ret = write(fd, buf, size);
-		if (ret == -1 && errno == EINTR) {
-			continue;
-		} else if (ret > 0) {
-			written += ret;
-			buf += ret;
-			size -= ret;
-		} else if (written) {
-			ret = written;
-			break;
-		} else {
-			break;
-		}
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		return -1;
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+	if (st.st_size == 0) {
+		close(fd);
+		errno = EINVAL;
+		return -1;
 	}
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == (void *)-1)
+		return -1;
+
+	tile_status_init(ts, ptr, st.st_size, bits, clear);
 
-	return ret;
+	return 0;
 }
 
-static int safe_read(int fd, void *buf, size_t size)
+/*
+ * Detile each frame of a tiled YUV input.  Image output converts the
+ * first frame; YUV output converts all of them.
+ */
+static int detile_yuv(const char *prog, int fd, size_t file_size,
+	enum yuv_format in_format, unsigned int flags, unsigned int width,
+	unsigned int height, int format, enum yuv_format out_format)
 {
-	size_t rd = 0;
+	struct yuv_frame f;
+	struct image *img = NULL;
+	const void *map = NULL, *src;
+	void *buf = NULL;
+	size_t pos;
 	ssize_t ret = 0;
 
-	while (size) {
-		ret = read(fd, buf, size);
-		if (ret == -1 && errno == EINTR) {
-			continue;
-		} else if (ret > 0) {
-			rd += ret;
-			buf += ret;
-			size -= ret;
-		} else if (rd) {
-			ret = rd;
-			break;
-		} else {
-			break;
-		}
+	if (yuv_frame_init(&f, in_format, flags, width, height)) {
+		fprintf(stderr, "%s: %s\n", prog, errno == EINVAL ?
+			"YUV width and height must be multiples of 8" :
+			"out of memory");
+		return 1;
 	}
 
-	return ret;
-}
+	if (file_size) {
+		if (f.size > file_size) {
+			fprintf(stderr, "%s: width/height exceeds file size\n",
+				prog);
+			return 1;
+		}
+		map = mmap(NULL, file_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map == (void *)-1) {
+			fprintf(stderr, "%s: failed to mmap: %m\n", prog);
+			return 1;
+		}
+		madvise((void *)map, file_size, MADV_SEQUENTIAL);
+	} else {
+		buf = malloc(f.size);
+		if (!buf) {
+			fprintf(stderr, "%s: out of memory\n", prog);
+			return 1;
+		}
+	}
 
+	if (format != IMAGE_RAW) {
+		img = image_open(1, format, width, height, 4);
+		if (!img) {
+			fprintf(stderr, "%s: %m\n", prog);
+			return 1;
+		}
+	}
 
-static void detile_gen(void *dst, void *src, unsigned int unit_size,
-	unsigned int tile_width, unsigned int tile_height,
-	unsigned int blocks_x, unsigned int blocks_y)
-{
-	unsigned int major_x, minor_x, major_y, minor_y;
-	unsigned int tile_size = tile_width * tile_height;
-	unsigned int tile_stride = tile_size * blocks_x;
-	unsigned int src_p, dst_p;
-
-	for (major_y = 0; major_y < blocks_y; major_y++) {
-		for (minor_y = 0; minor_y < tile_height; minor_y++) {
-			unsigned int dst_y = major_y * tile_height + minor_y;
-
-			for (major_x = 0; major_x < blocks_x; major_x++) {
-				for (minor_x = 0; minor_x < tile_width; minor_x++) {
-					unsigned int dst_x = major_x * tile_width + minor_x;
-					unsigned int src_maj = major_y * tile_stride + major_x * tile_size;
-					unsigned int src_min = minor_y * tile_width + minor_x;
-
-					dst_p = (dst_y * tile_width * blocks_x + dst_x) * unit_size;
-					src_p = (src_maj + src_min) * unit_size;
-					memcpy(dst + dst_p, src + src_p, unit_size);
-				}
+	for (pos = 0; !ret; pos += f.size) {
+		if (map) {
+			if (pos + f.size > file_size)
+				break;
+			src = map + pos;
+		} else {
+			ret = safe_read(fd, buf, f.size);
+			if (ret == 0)
+				break;
+			if (ret > 0 && ret != f.size) {
+				fprintf(stderr, "%s: short read\n", prog);
+				return 1;
 			}
+			if (ret < 0)
+				break;
+			ret = 0;
+			src = buf;
 		}
+
+		yuv_detile(&f, src);
+		if (img) {
+			ret = yuv_write_image(&f, img);
+			break;
+		}
+		ret = yuv_write(&f, 1, out_format);
 	}
-}
 
-static void demultitile(void *dst, void *src, unsigned ps, unsigned w, unsigned h)
-{
-	void *tmp = malloc(ps * w * h);
-	void *src_u, *src_l;
-	unsigned int tile_bytes;
-	unsigned int tile_stride;
-	unsigned int tile_w = w / 4;
-	unsigned int tile_h = h / 4;
-	int x, y;
-
-	/*
-	 * 4  8  12 16 20 24 28 32 36  40  44  48  52  56  60  64
-	 * u1 u2 l1 l2 u5 u6 l5 l6 u9  u10 l9  l10 u13 u14 l13 l14
-	 * l3 l4 u3 u4 l7 l8 u7 u8 l11 l12 u11 u12 l15 l16 u15 u16
-	 */
-
-	tile_bytes = ps * 4 * 4; /* each 4x4 tile */
-	tile_stride = tile_bytes * tile_w; /* one full row of tiles */
-
-	src_u = src;
-	src_l = src + tile_stride * tile_h / 2;
-
-	if (0) {
-		fprintf(stderr, "tile bytes = 0x%x\n", tile_bytes);
-		fprintf(stderr, "tile stride = 0x%x\n", tile_stride);
-		fprintf(stderr, "u -> l = 0x%x\n", src_l - src_u);
-	}
-
-	for (y = 0; y < tile_h / 2; y++) {
-		void *dpyu = tmp + y * 2 * tile_stride;
-		void *dpyl = dpyu + tile_stride;
-		void *spyu = src_u + y * tile_stride; /* upper half */
-		void *spyl = src_l + y * tile_stride; /* lower half */
-		for (x = 0; x < tile_w / 4; x++) {
-			void *dpu = dpyu + x * 4 * tile_bytes;
-			void *dpl = dpyl + x * 4 * tile_bytes;
-			void *spu = spyu + x * 4 * tile_bytes;
-			void *spl = spyl + x * 4 * tile_bytes;
-
-			memcpy(dpu, spu, 2 * tile_bytes);
-			memcpy(dpu + 2 * tile_bytes, spl, 2 * tile_bytes);
-			memcpy(dpl, spl + 2 * tile_bytes, 2 * tile_bytes);
-			memcpy(dpl + 2 * tile_bytes, spu + 2 * tile_bytes, 2 * tile_bytes);
-		}
-	}
-
-	detile_gen(dst, tmp, ps, 4, 4, tile_w, tile_h);
-	free(tmp);
+	if (img && image_close(img))
+		ret = -1;
+	if (ret)
+		fprintf(stderr, "%s: %m\n", prog);
+
+	yuv_frame_fini(&f);
+	free(buf);
+
+	return ret ? 1 : 0;
 }
 
-static void detile(void *dst, void *src, unsigned ps, unsigned w, unsigned h)
+static void usage(const char *prog)
 {
-	detile_gen(dst, src, ps, 4, 4, w / 4, h / 4);
+	fprintf(stderr, "Usage: %s [--stats] [-w WIDTH] [-h HEIGHT] [-b BYTES_PER_PIXEL] [-m] [-s] [-t] [-f raw|ppm|pam|png]\n"
+		"       [-T TILE_STATUS [-c CLEAR_VALUE] [-B TS_BITS]] [-M 2|4 [-S SAMPLE]]\n"
+		"       [-j THREADS] [FILE]\n"
+		"       %s [--stats] -y yuy2|nv12|i420 -w WIDTH -h HEIGHT [-m] [-s]\n"
+		"          [-f raw|nv12|i420|ppm|pam|png] [-j THREADS] [FILE]\n",
+		prog, prog);
+	exit(1);
 }
 
 int main(int argc, char *argv[])
 {
 	struct stat st;
+	struct input in;
+	struct image *img;
+	struct tile_status ts;
+	unsigned int ts_bits = 2;
+	const char *ts_name = NULL;
+	uint64_t clear = 0;
 	void *ptr, *out;
 	int fd = 0;
-	int opt, ret, cpp = 4, width = 0, height = -1, multitile = 0;
-	size_t size;
-
-	while ((opt = getopt(argc, argv, "w:h:m")) != -1) {
+	int opt, cpp = 4, width = 0, height = -1, tiling = 0;
+	int format = IMAGE_RAW, streaming, unbounded = 0;
+	int yuv_in = -1, yuv_out = -1;
+	struct msaa msaa = { .sample = -1 };
+	unsigned int msaa_x = 1, msaa_y = 1;
+	unsigned int flags = 0;
+	struct layout layout;
+	size_t in_size, out_size;
+	ssize_t ret;
+	int phase;
+
+	stats_init(&argc, argv);
+	detile_init();
+
+	while ((opt = getopt(argc, argv, "w:h:b:mstf:T:c:B:j:y:M:S:")) != -1) {
 		switch (opt) {
 		case 'w':
 			width = strtoul(optarg, NULL, 10);
@@ -156,14 +177,110 @@ int main(int argc, char *argv[])
 		case 'h':
 			height = strtoul(optarg, NULL, 10);
 			break;
+		case 'b':
+			cpp = strtoul(optarg, NULL, 10);
+			if (cpp == 0) {
+				fprintf(stderr, "%s: invalid bytes per pixel\n",
+					argv[0]);
+				return 1;
+			}
+			break;
 		case 'm':
-			multitile = 1;
+			flags |= LAYOUT_MULTI;
+			break;
+		case 's':
+			flags |= LAYOUT_SUPER;
+			break;
+		case 't':
+			tiling = 1;
+			break;
+		case 'f':
+			format = image_format(optarg);
+			if (format < 0) {
+				format = IMAGE_RAW;
+				yuv_out = yuv_format(optarg);
+				if (yuv_out < 0 || yuv_out == YUV_YUY2)
+					usage(argv[0]);
+			}
+			break;
+		case 'T':
+			ts_name = optarg;
+			break;
+		case 'c':
+			clear = strtoull(optarg, NULL, 0);
+			break;
+		case 'B':
+			ts_bits = strtoul(optarg, NULL, 10);
+			if (ts_bits != 2 && ts_bits != 4)
+				usage(argv[0]);
+			break;
+		case 'j':
+			job_set_threads(strtoul(optarg, NULL, 10));
+			break;
+		case 'y':
+			yuv_in = yuv_format(optarg);
+			if (yuv_in < 0)
+				usage(argv[0]);
+			break;
+		case 'M':
+			msaa.samples = strtoul(optarg, NULL, 10);
+			if (msaa.samples != 2 && msaa.samples != 4)
+				usage(argv[0]);
+			msaa_x = 2;
+			msaa_y = msaa.samples / 2;
+			break;
+		case 'S':
+			msaa.sample = strtoul(optarg, NULL, 10);
 			break;
 		default:
-			fprintf(stderr, "Usage: %s [-w WIDTH] [-h HEIGHT] [FILE]\n",
+			usage(argv[0]);
+		}
+	}
+
+	if (msaa.samples && (tiling || yuv_in >= 0)) {
+		fprintf(stderr, "%s: -M only applies when detiling\n", argv[0]);
+		return 1;
+	}
+	if (msaa.sample >= (int)msaa.samples) {
+		fprintf(stderr, "%s: -S needs -M with more samples\n", argv[0]);
+		return 1;
+	}
+	if (msaa.samples && msaa.sample < 0 && cpp != 1 && cpp != 4) {
+		fprintf(stderr, "%s: resolving needs 1 or 4 bytes per pixel, use -S\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (yuv_out >= 0 && yuv_in < 0) {
+		fprintf(stderr, "%s: YUV output needs -y\n", argv[0]);
+		return 1;
+	}
+	if (yuv_in >= 0 && (tiling || ts_name || width <= 0 || height <= 0)) {
+		fprintf(stderr, "%s: -y needs -w and -h, and no -t or -T\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (format != IMAGE_RAW && tiling) {
+		fprintf(stderr, "%s: -t only writes raw output\n", argv[0]);
+		return 1;
+	}
+	if (format != IMAGE_RAW && cpp != 1 && cpp != 4) {
+		fprintf(stderr, "%s: image output needs 1 or 4 bytes per pixel\n",
+			argv[0]);
+		return 1;
+	}
+
+	if (ts_name) {
+		if (tiling) {
+			fprintf(stderr, "%s: -T only applies when detiling\n",
 				argv[0]);
 			return 1;
 		}
+		if (tile_status_open(&ts, ts_name, ts_bits, clear)) {
+			fprintf(stderr, "%s: %s: %m\n", argv[0], ts_name);
+			return 1;
+		}
 	}
 
 	if (optind < argc) {
@@ -182,12 +299,44 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
-	if (height == -1)
-		height = st.st_size / (width * cpp);
+	if (yuv_in >= 0) {
+		phase = stats_begin("detile");
+		ret = detile_yuv(argv[0], fd, st.st_size, yuv_in, flags, width,
+				 height, format, yuv_out < 0 ? yuv_in : yuv_out);
+		stats_end(phase, st.st_size, height);
+		close(fd);
+		return ret;
+	}
+
+	streaming = !st.st_size && !tiling;
+	if (height == -1) {
+		if (streaming && (flags & LAYOUT_MULTI || format != IMAGE_RAW)) {
+			fprintf(stderr, "%s: %s need -h when reading a pipe\n",
+				argv[0], format != IMAGE_RAW ? "images" :
+				"multi-pipe layouts");
+			close(fd);
+			return 1;
+		}
+		height = streaming ? 0 : st.st_size / (width * cpp);
+		unbounded = streaming;
+	}
+
+	if (layout_init(&layout, flags, cpp, width, height)) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		close(fd);
+		return 1;
+	}
+
+	if (tiling) {
+		in_size = cpp * width * height;
+		out_size = layout.src_size;
+	} else {
+		in_size = layout.src_size;
+		out_size = cpp * width * height;
+	}
 
-	size = cpp * width * height;
 	if (st.st_size) {
-		if (size > st.st_size) {
+		if (in_size > st.st_size) {
 			fprintf(stderr, "%s: width/height exceeds file size\n",
 				argv[0]);
 			close(fd);
@@ -200,42 +349,89 @@ int main(int argc, char *argv[])
 			close(fd);
 			return 1;
 		}
+		madvise(ptr, st.st_size, MADV_SEQUENTIAL);
 	} else {
-		ptr = malloc(size);
+		ptr = NULL;
+	}
+
+	if (!tiling) {
+		/* Raw output keeps the detiled line pitch, as it always has */
+		if (format == IMAGE_RAW)
+			img = image_open(1, IMAGE_RAW, width / msaa_x,
+					 unbounded ? IMAGE_UNBOUNDED :
+					 height / msaa_y, cpp);
+		else
+			img = image_open(1, format,
+					 layout.blocks_x * 4 / msaa_x,
+					 height / msaa_y, cpp);
+		if (!img) {
+			fprintf(stderr, "%s: %m\n", argv[0]);
+			close(fd);
+			return 1;
+		}
+
+		in.fd = fd;
+		in.map = ptr;
+		in.size = st.st_size;
+		in.pos = 0;
+		in.bytes = 0;
+		in.rows = 0;
+		phase = stats_begin("detile");
+		ret = stream_detile(&in, img, &layout, ts_name ? &ts : NULL,
+				    msaa.samples ? &msaa : NULL, unbounded);
+		stats_end(phase, in.bytes, in.rows);
+		phase = stats_begin("close");
+		if (image_close(img))
+			ret = -1;
+		stats_end(phase, 0, 1);
+		if (ret)
+			fprintf(stderr, "%s: %m\n", argv[0]);
+		close(fd);
+		return ret ? 1 : 0;
+	}
+
+	if (!ptr) {
+		phase = stats_begin("read");
+		ptr = malloc(in_size);
 		if (!ptr) {
 			fprintf(stderr, "%s: out of memory\n", argv[0]);
 			close(fd);
 			return 1;
 		}
-		ret = safe_read(fd, ptr, size);
+		ret = safe_read(fd, ptr, in_size);
 		if (ret < 0) {
 			fprintf(stderr, "%s: %m\n", argv[0]);
 			free(ptr);
 			close(fd);
 			return 1;
-		} else if (ret != size) {
+		} else if (ret != in_size) {
 			fprintf(stderr, "%s: short read\n", argv[0]);
 			free(ptr);
 			close(fd);
 			return 1;
 		}
+		stats_end(phase, in_size, 1);
 	}
 
-	out = malloc(size);
-
-	if (multitile)
-		demultitile(out, ptr, cpp, width, height);
-	else
-		detile(out, ptr, cpp, width, height);
+	out = calloc(1, out_size);
+	if (!out) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	phase = stats_begin("tile");
+	tile(out, ptr, &layout);
+	stats_end(phase, in_size, layout.blocks_y);
 
-	ret = safe_write(1, out, size);
+	phase = stats_begin("write");
+	ret = safe_write(1, out, out_size);
+	stats_end(phase, ret > 0 ? ret : 0, 1);
 
 	free(out);
 
 	if (ret < 0) {
 		fprintf(stderr, "%s: write: %m\n", argv[0]);
 		return 1;
-	} else if (ret != size) {
+	} else if (ret != out_size) {
 		fprintf(stderr, "%s: short write\n", argv[0]);
 		return 1;
 	}
@@ -0,0 +1,536 @@
+/*
+ * Decode DXT1/3/5 and ETC1 compressed textures to A8R8G8B8.
+ *
+ * A compressed texture is a grid of 4x4 pixel blocks, 8 or 16 bytes
+ * each.  The grid may itself be tiled like any other surface, with a
+ * block in place of a pixel, so the block order is undone with the
+ * detile layout code before decoding.
+ *
+ * Every format decodes a block to a palette of up to eight colours, an
+ * index into it for each of the 16 pixels, and for DXT3/5 a separate
+ * alpha for each pixel.  Expanding that into four lines of pixels is
+ * the part done with vector shuffles.
+ */
+#include <errno.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD 1
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "image.h"
+#include "job.h"
+#include "tile.h"
+
+enum tex_format {
+	TEX_DXT1,
+	TEX_DXT3,
+	TEX_DXT5,
+	TEX_ETC1,
+};
+
+static const struct {
+	const char *name;
+	unsigned int block_bytes;
+} tex_formats[] = {
+	[TEX_DXT1] = { "dxt1", 8 },
+	[TEX_DXT3] = { "dxt3", 16 },
+	[TEX_DXT5] = { "dxt5", 16 },
+	[TEX_ETC1] = { "etc1", 8 },
+};
+
+/* A decoded block: A8R8G8B8 palette entries, per pixel indices and alpha */
+struct block {
+	uint8_t pal[32] __attribute__((aligned(16)));
+	uint8_t idx[16] __attribute__((aligned(16)));
+	uint8_t alpha[16] __attribute__((aligned(16)));
+	int has_alpha;
+};
+
+static inline unsigned int get_le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static inline void set_color(uint8_t *p, unsigned int r, unsigned int g,
+	unsigned int b, unsigned int a)
+{
+	p[0] = b;
+	p[1] = g;
+	p[2] = r;
+	p[3] = a;
+}
+
+static inline void rgb565(uint8_t *p, unsigned int c)
+{
+	unsigned int r = c >> 11, g = c >> 5 & 63, b = c & 31;
+
+	set_color(p, r << 3 | r >> 2, g << 2 | g >> 4, b << 3 | b >> 2, 255);
+}
+
+/* The colour half of a DXT block; DXT3/5 always use four colours */
+static void decode_dxt_color(struct block *b, const uint8_t *p, int dxt1)
+{
+	unsigned int c0 = get_le16(p), c1 = get_le16(p + 2), i, c;
+	uint8_t *pal = b->pal;
+
+	rgb565(pal, c0);
+	rgb565(pal + 4, c1);
+	if (c0 > c1 || !dxt1) {
+		for (c = 0; c < 3; c++) {
+			pal[8 + c] = (2 * pal[c] + pal[4 + c]) / 3;
+			pal[12 + c] = (pal[c] + 2 * pal[4 + c]) / 3;
+		}
+		pal[11] = pal[15] = 255;
+	} else {
+		for (c = 0; c < 3; c++)
+			pal[8 + c] = (pal[c] + pal[4 + c]) / 2;
+		pal[11] = 255;
+		set_color(pal + 12, 0, 0, 0, 0);
+	}
+
+	for (i = 0; i < 16; i++)
+		b->idx[i] = p[4 + i / 4] >> (2 * (i % 4)) & 3;
+}
+
+static void decode_dxt3_alpha(struct block *b, const uint8_t *p)
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++)
+		b->alpha[i] = (p[i / 2] >> (4 * (i & 1)) & 15) * 17;
+	b->has_alpha = 1;
+}
+
+static void decode_dxt5_alpha(struct block *b, const uint8_t *p)
+{
+	unsigned int a0 = p[0], a1 = p[1], i;
+	uint64_t bits = 0;
+	uint8_t a[8];
+
+	a[0] = a0;
+	a[1] = a1;
+	if (a0 > a1) {
+		for (i = 1; i < 7; i++)
+			a[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+	} else {
+		for (i = 1; i < 5; i++)
+			a[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+		a[6] = 0;
+		a[7] = 255;
+	}
+
+	for (i = 0; i < 6; i++)
+		bits |= (uint64_t)p[2 + i] << (8 * i);
+	for (i = 0; i < 16; i++)
+		b->alpha[i] = a[bits >> (3 * i) & 7];
+	b->has_alpha = 1;
+}
+
+static const int etc1_modifiers[8][2] = {
+	{ 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 },
+	{ 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 },
+};
+
+static inline uint8_t clamp8(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/*
+ * ETC1 blocks are big-endian.  The two sub-blocks each have a base
+ * colour and a modifier table, giving palette entries 0-3 and 4-7.
+ * Pixel indices are stored column by column.
+ */
+static void decode_etc1(struct block *b, const uint8_t *p)
+{
+	uint32_t hi = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+	uint32_t lo = (uint32_t)p[4] << 24 | p[5] << 16 | p[6] << 8 | p[7];
+	int base[2][3], s, c, m, flip = hi & 1;
+	unsigned int i;
+
+	for (c = 0; c < 3; c++) {
+		unsigned int v = hi >> (24 - 8 * c);
+
+		if (hi & 2) {
+			int c1 = v >> 3 & 31;
+			int c2 = c1 + ((int)(v & 7) ^ 4) - 4;
+
+			base[0][c] = c1 << 3 | c1 >> 2;
+			base[1][c] = (c2 & 31) << 3 | (c2 & 31) >> 2;
+		} else {
+			base[0][c] = (v >> 4 & 15) * 17;
+			base[1][c] = (v & 15) * 17;
+		}
+	}
+
+	for (s = 0; s < 2; s++) {
+		const int *mod = etc1_modifiers[hi >> (5 - 3 * s) & 7];
+
+		for (m = 0; m < 4; m++) {
+			int d = m & 2 ? -mod[m & 1] : mod[m & 1];
+
+			set_color(b->pal + 16 * s + 4 * m,
+				  clamp8(base[s][0] + d), clamp8(base[s][1] + d),
+				  clamp8(base[s][2] + d), 255);
+		}
+	}
+
+	for (i = 0; i < 16; i++) {
+		unsigned int x = i % 4, y = i / 4, bit = x * 4 + y;
+
+		b->idx[i] = ((lo >> (bit + 16) & 1) << 1 | (lo >> bit & 1)) |
+			    ((flip ? y : x) >= 2) << 2;
+	}
+}
+
+static void decode_block(struct block *b, enum tex_format fmt,
+	const uint8_t *p)
+{
+	b->has_alpha = 0;
+
+	switch (fmt) {
+	case TEX_DXT1:
+		decode_dxt_color(b, p, 1);
+		break;
+	case TEX_DXT3:
+		decode_dxt3_alpha(b, p);
+		decode_dxt_color(b, p + 8, 0);
+		break;
+	case TEX_DXT5:
+		decode_dxt5_alpha(b, p);
+		decode_dxt_color(b, p + 8, 0);
+		break;
+	case TEX_ETC1:
+		decode_etc1(b, p);
+		break;
+	}
+}
+
+/* Write the 4x4 pixels of a decoded block, lines @stride bytes apart */
+typedef void (*expand_fn)(void *dst, size_t stride, const struct block *b);
+
+static void expand_c(void *dst, size_t stride, const struct block *b)
+{
+	unsigned int x, y;
+
+	for (y = 0; y < 4; y++, dst += stride) {
+		uint8_t *d = dst;
+
+		for (x = 0; x < 4; x++, d += 4) {
+			memcpy(d, b->pal + 4 * b->idx[4 * y + x], 4);
+			if (b->has_alpha)
+				d[3] = b->alpha[4 * y + x];
+		}
+	}
+}
+
+/* Shuffles spreading the index of each pixel of line y to its bytes */
+static const uint8_t spread[4][16] __attribute__((aligned(16), unused)) = {
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 },
+	{ 4, 4, 4, 4, 5, 5, 5, 5, 6, 6, 6, 6, 7, 7, 7, 7 },
+	{ 8, 8, 8, 8, 9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11 },
+	{ 12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15 },
+};
+
+#if defined(HAVE_X86_SIMD)
+/*
+ * Each line of four pixels is one pshufb from the palette: the index of
+ * each pixel is spread to its four bytes, times four plus the byte
+ * number.  Entries 4-7 come from the second half of the palette.
+ */
+__attribute__((target("ssse3")))
+static void expand_ssse3(void *dst, size_t stride, const struct block *b)
+{
+	const __m128i pal0 = _mm_load_si128((const __m128i *)b->pal);
+	const __m128i pal1 = _mm_load_si128((const __m128i *)(b->pal + 16));
+	const __m128i idx = _mm_load_si128((const __m128i *)b->idx);
+	const __m128i alpha = _mm_load_si128((const __m128i *)b->alpha);
+	const __m128i byte = _mm_set1_epi32(0x03020100);
+	const __m128i high = _mm_set1_epi8(15);
+	const __m128i zero = _mm_set1_epi8(0x80);
+	const __m128i amask = _mm_set1_epi32(0xff000000);
+	unsigned int y;
+
+	for (y = 0; y < 4; y++, dst += stride) {
+		__m128i s = _mm_load_si128((const __m128i *)spread[y]);
+		__m128i m = _mm_shuffle_epi8(idx, s);
+		__m128i sel, px;
+
+		m = _mm_add_epi8(_mm_slli_epi16(m, 2), byte);
+		sel = _mm_cmpgt_epi8(m, high);
+		px = _mm_or_si128(
+			_mm_shuffle_epi8(pal0, _mm_or_si128(m,
+				_mm_and_si128(sel, zero))),
+			_mm_shuffle_epi8(pal1, _mm_or_si128(m,
+				_mm_andnot_si128(sel, zero))));
+
+		if (b->has_alpha)
+			px = _mm_or_si128(_mm_andnot_si128(amask, px),
+				_mm_and_si128(amask,
+					      _mm_shuffle_epi8(alpha, s)));
+
+		_mm_storeu_si128(dst, px);
+	}
+}
+#endif
+
+#if defined(__ARM_NEON) && defined(__aarch64__)
+static void expand_neon(void *dst, size_t stride, const struct block *b)
+{
+	const uint8x16x2_t pal = { {
+		vld1q_u8(b->pal), vld1q_u8(b->pal + 16),
+	} };
+	const uint8x16_t idx = vld1q_u8(b->idx);
+	const uint8x16_t alpha = vld1q_u8(b->alpha);
+	const uint8x16_t byte = vreinterpretq_u8_u32(vdupq_n_u32(0x03020100));
+	const uint8x16_t amask = vreinterpretq_u8_u32(vdupq_n_u32(0xff000000));
+	unsigned int y;
+
+	for (y = 0; y < 4; y++, dst += stride) {
+		uint8x16_t s = vld1q_u8(spread[y]);
+		uint8x16_t m = vqtbl1q_u8(idx, s);
+		uint8x16_t px;
+
+		m = vaddq_u8(vshlq_n_u8(m, 2), byte);
+		px = vqtbl2q_u8(pal, m);
+		if (b->has_alpha)
+			px = vbslq_u8(amask, vqtbl1q_u8(alpha, s), px);
+
+		vst1q_u8(dst, px);
+	}
+}
+#endif
+
+static expand_fn expand = expand_c;
+
+static void texdec_init(void)
+{
+#if defined(HAVE_X86_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3"))
+		expand = expand_ssse3;
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+	expand = expand_neon;
+#endif
+}
+
+/* Rows are rows of blocks, relative to @src and @dst */
+struct decode_job {
+	enum tex_format fmt;
+	const uint8_t *src;
+	uint8_t *dst;
+	unsigned int blocks_x;
+	size_t src_stride;	/* bytes per row of blocks */
+};
+
+static void decode_job_rows(void *arg, unsigned int first, unsigned int num)
+{
+	struct decode_job *j = arg;
+	size_t block_bytes = tex_formats[j->fmt].block_bytes;
+	size_t stride = (size_t)j->blocks_x * 16;
+	struct block b;
+	unsigned int row, x;
+
+	for (row = first; row < first + num; row++) {
+		const uint8_t *src = j->src + row * j->src_stride;
+		uint8_t *dst = j->dst + row * 4 * stride;
+
+		for (x = 0; x < j->blocks_x; x++) {
+			decode_block(&b, j->fmt, src + x * block_bytes);
+			expand(dst + x * 16, stride, &b);
+		}
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s -c dxt1|dxt3|dxt5|etc1 -w WIDTH [-h HEIGHT] [-t] [-m] [-s]\n"
+		"       [-f raw|ppm|pam|png] [-j THREADS] [FILE]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt, fmt = -1, format = IMAGE_RAW, tiled = 0;
+	unsigned int width = 0, height = 0, flags = 0;
+	unsigned int blocks_x, blocks_y, rows, row, i;
+	size_t block_bytes, size, row_bytes;
+	struct decode_job j;
+	struct layout layout;
+	struct image *img;
+	struct stat st;
+	void *ptr, *linear = NULL;
+	uint8_t *dst;
+	int fd, ret = 0;
+
+	detile_init();
+	texdec_init();
+
+	while ((opt = getopt(argc, argv, "c:w:h:tmsf:j:")) != -1) {
+		switch (opt) {
+		case 'c':
+			for (i = 0; i < sizeof(tex_formats) / sizeof(tex_formats[0]); i++)
+				if (!strcmp(optarg, tex_formats[i].name))
+					fmt = i;
+			if (fmt < 0)
+				usage(argv[0]);
+			break;
+		case 'w':
+			width = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			height = strtoul(optarg, NULL, 10);
+			break;
+		case 't':
+			tiled = 1;
+			break;
+		case 'm':
+			tiled = 1;
+			flags |= LAYOUT_MULTI;
+			break;
+		case 's':
+			tiled = 1;
+			flags |= LAYOUT_SUPER;
+			break;
+		case 'f':
+			format = image_format(optarg);
+			if (format < 0)
+				usage(argv[0]);
+			break;
+		case 'j':
+			job_set_threads(strtoul(optarg, NULL, 10));
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (fmt < 0 || width < 4)
+		usage(argv[0]);
+
+	if (optind < argc) {
+		fd = open(argv[optind], O_RDONLY);
+		if (fd == -1) {
+			fprintf(stderr, "%s: %s: %m\n", argv[0], argv[optind]);
+			return 1;
+		}
+	} else {
+		fd = dup(0);
+	}
+
+	if (fstat(fd, &st) == -1) {
+		fprintf(stderr, "%s: failed to stat: %m\n", argv[0]);
+		return 1;
+	}
+
+	block_bytes = tex_formats[fmt].block_bytes;
+	blocks_x = width / 4;
+	row_bytes = blocks_x * block_bytes;
+	if (!height && st.st_size)
+		height = st.st_size / row_bytes * 4;
+	blocks_y = height / 4;
+	if (!blocks_y) {
+		fprintf(stderr, "%s: no height\n", argv[0]);
+		return 1;
+	}
+
+	/*
+	 * The block grid as a surface of block-sized pixels, rounded up to
+	 * whole tiles; the padding is in the surface anyway.
+	 */
+	if (tiled && layout_init(&layout, flags, block_bytes,
+				 (blocks_x + 3) & ~3, (blocks_y + 3) & ~3)) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+	size = tiled ? layout.src_size : row_bytes * blocks_y;
+
+	if (st.st_size) {
+		if (size > st.st_size) {
+			fprintf(stderr, "%s: width/height exceeds file size\n",
+				argv[0]);
+			return 1;
+		}
+		ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (ptr == (void *)-1) {
+			fprintf(stderr, "%s: failed to mmap: %m\n", argv[0]);
+			return 1;
+		}
+	} else {
+		ptr = malloc(size);
+		if (!ptr) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+		if (safe_read(fd, ptr, size) != size) {
+			fprintf(stderr, "%s: short read\n", argv[0]);
+			return 1;
+		}
+	}
+	close(fd);
+
+	if (tiled) {
+		row_bytes = (size_t)layout.blocks_x * 4 * block_bytes;
+		linear = malloc(row_bytes * layout.blocks_y * 4);
+		if (!linear) {
+			fprintf(stderr, "%s: out of memory\n", argv[0]);
+			return 1;
+		}
+		detile(linear, ptr, &layout);
+		layout_fini(&layout);
+		ptr = linear;
+	}
+
+	img = image_open_pixel(1, format, blocks_x * 4, blocks_y * 4,
+			       PIXEL_A8R8G8B8);
+	if (!img) {
+		fprintf(stderr, "%s: %m\n", argv[0]);
+		return 1;
+	}
+
+	/* Decode and write out a few rows of blocks at a time */
+	rows = CHUNK_BYTES * nr_threads / (blocks_x * 64);
+	if (rows == 0)
+		rows = 1;
+	dst = malloc((size_t)rows * blocks_x * 64);
+	if (!dst) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	j.fmt = fmt;
+	j.dst = dst;
+	j.blocks_x = blocks_x;
+	j.src_stride = row_bytes;
+	for (row = 0; row < blocks_y && !ret; row += rows) {
+		unsigned int n = blocks_y - row < rows ? blocks_y - row : rows;
+
+		j.src = ptr + row * row_bytes;
+		run_job(decode_job_rows, &j, n, (size_t)blocks_x * 64);
+		ret = image_write(img, dst, 4 * n, (size_t)blocks_x * 16);
+	}
+	if (image_close(img))
+		ret = -1;
+	if (ret)
+		fprintf(stderr, "%s: write: %m\n", argv[0]);
+
+	free(dst);
+	free(linear);
+
+	return ret ? 1 : 0;
+}
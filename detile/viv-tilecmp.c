@@ -0,0 +1,303 @@
+/*
+ * Compare two surfaces in their tiled layout.
+ *
+ * Every tile is 16 pixels stored contiguously, whatever the layout, so
+ * the two surfaces are compared tile by tile in memory order without
+ * detiling either.  Identical tiles, the common case, are found with an
+ * early-out equality check; only differing tiles have their error
+ * measured.  The per-tile results are then walked in linear order through
+ * the layout to report positions and build the heat map.
+ *
+ * Errors are per byte, so per channel for 8 bit formats.
+ */
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "image.h"
+#include "job.h"
+#include "tile.h"
+
+/*
+ * Compare one tile of @size bytes, a multiple of 16.  Returns the
+ * largest byte difference, and adds up the differences in @sum.
+ */
+#if defined(__SSE2__)
+static unsigned int cmp_tile(const uint8_t *a, const uint8_t *b, size_t size,
+	unsigned int *sum)
+{
+	__m128i max = _mm_setzero_si128(), sad = _mm_setzero_si128();
+	size_t i;
+
+	for (i = 0; i < size; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+			break;
+	}
+	if (i == size)
+		return 0;
+
+	for (; i < size; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		__m128i d = _mm_or_si128(_mm_subs_epu8(va, vb),
+					 _mm_subs_epu8(vb, va));
+
+		max = _mm_max_epu8(max, d);
+		sad = _mm_add_epi64(sad, _mm_sad_epu8(d, _mm_setzero_si128()));
+	}
+
+	max = _mm_max_epu8(max, _mm_srli_si128(max, 8));
+	max = _mm_max_epu8(max, _mm_srli_si128(max, 4));
+	max = _mm_max_epu8(max, _mm_srli_si128(max, 2));
+	max = _mm_max_epu8(max, _mm_srli_si128(max, 1));
+	*sum += _mm_cvtsi128_si32(sad) + _mm_cvtsi128_si32(_mm_srli_si128(sad, 8));
+
+	return _mm_cvtsi128_si32(max) & 0xff;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static unsigned int cmp_tile(const uint8_t *a, const uint8_t *b, size_t size,
+	unsigned int *sum)
+{
+	uint8x16_t max = vdupq_n_u8(0);
+	uint32_t s = 0;
+	size_t i;
+
+	for (i = 0; i < size; i += 16)
+		if (vmaxvq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i))))
+			break;
+	if (i == size)
+		return 0;
+
+	for (; i < size; i += 16) {
+		uint8x16_t d = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+
+		max = vmaxq_u8(max, d);
+		s += vaddlvq_u8(d);
+	}
+	*sum += s;
+
+	return vmaxvq_u8(max);
+}
+#else
+static unsigned int cmp_tile(const uint8_t *a, const uint8_t *b, size_t size,
+	unsigned int *sum)
+{
+	unsigned int max = 0, d;
+	size_t i;
+
+	if (!memcmp(a, b, size))
+		return 0;
+
+	for (i = 0; i < size; i++) {
+		d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+		if (d > max)
+			max = d;
+		*sum += d;
+	}
+
+	return max;
+}
+#endif
+
+/* Per-tile results, indexed by the tile's position in memory */
+struct cmp_job {
+	const uint8_t *a;
+	const uint8_t *b;
+	size_t tile_bytes;
+	unsigned int row_tiles;
+	uint8_t *max;
+	uint16_t *sum;
+};
+
+static void cmp_job_rows(void *arg, unsigned int first, unsigned int num)
+{
+	struct cmp_job *j = arg;
+	size_t t = (size_t)first * j->row_tiles;
+	size_t end = t + (size_t)num * j->row_tiles;
+
+	for (; t < end; t++) {
+		unsigned int sum = 0;
+
+		j->max[t] = cmp_tile(j->a + t * j->tile_bytes,
+				     j->b + t * j->tile_bytes, j->tile_bytes,
+				     &sum);
+		j->sum[t] = sum;
+	}
+}
+
+static const void *map_surface(const char *name, size_t size)
+{
+	struct stat st;
+	void *ptr;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		error(2, errno, "%s", name);
+	if (fstat(fd, &st) == -1)
+		error(2, errno, "%s", name);
+	if (st.st_size < size)
+		error(2, 0, "%s: width/height exceeds file size", name);
+
+	ptr = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == (void *)-1)
+		error(2, errno, "%s: mmap", name);
+	close(fd);
+
+	return ptr;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s -w WIDTH -h HEIGHT [-b BYTES_PER_PIXEL] [-m] [-s] [-t TOLERANCE]\n"
+		"       [-q] [-o HEATMAP [-f raw|ppm|pam|png]] [-j THREADS] FILE1 FILE2\n",
+		prog);
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int width = 0, height = 0, ps = 4, flags = 0, tolerance = 0;
+	unsigned int x, y, max = 0, nr_diff = 0;
+	const char *heatmap = NULL;
+	int opt, format = IMAGE_PNG, quiet = 0;
+	uint64_t total = 0;
+	struct layout layout;
+	struct cmp_job j;
+	size_t nr_tiles;
+	uint8_t *heat = NULL;
+
+	detile_init();
+
+	while ((opt = getopt(argc, argv, "w:h:b:mst:qo:f:j:")) != -1) {
+		switch (opt) {
+		case 'w':
+			width = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			height = strtoul(optarg, NULL, 10);
+			break;
+		case 'b':
+			ps = strtoul(optarg, NULL, 10);
+			if (ps == 0 || ps > 16)
+				usage(argv[0]);
+			break;
+		case 'm':
+			flags |= LAYOUT_MULTI;
+			break;
+		case 's':
+			flags |= LAYOUT_SUPER;
+			break;
+		case 't':
+			tolerance = strtoul(optarg, NULL, 10);
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 'o':
+			heatmap = optarg;
+			break;
+		case 'f':
+			format = image_format(optarg);
+			if (format < 0)
+				usage(argv[0]);
+			break;
+		case 'j':
+			job_set_threads(strtoul(optarg, NULL, 10));
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 2 || width < 4 || height < 4)
+		usage(argv[0]);
+
+	if (layout_init(&layout, flags, ps, width, height))
+		error(2, ENOMEM, "layout");
+
+	j.tile_bytes = 16 * ps;
+	j.row_tiles = layout.src_blocks_x;
+	j.a = map_surface(argv[optind], layout.src_size);
+	j.b = map_surface(argv[optind + 1], layout.src_size);
+	nr_tiles = layout.src_size / j.tile_bytes;
+	j.max = malloc(nr_tiles);
+	j.sum = malloc(nr_tiles * sizeof(*j.sum));
+	if (!j.max || !j.sum)
+		error(2, ENOMEM, "tile results");
+
+	run_job(cmp_job_rows, &j, nr_tiles / j.row_tiles,
+		j.row_tiles * j.tile_bytes * 2);
+
+	if (heatmap) {
+		heat = malloc((size_t)layout.blocks_x * layout.blocks_y);
+		if (!heat)
+			error(2, ENOMEM, "heat map");
+	}
+
+	/* Padding tiles are not part of the image, and are skipped */
+	if (!quiet)
+		printf("%5s %5s %4s %7s\n", "x", "y", "max", "mean");
+	for (y = 0; y < layout.blocks_y; y++) {
+		for (x = 0; x < layout.blocks_x; x++) {
+			size_t t = layout_tile_index(&layout, x, y);
+
+			if (heat)
+				heat[y * layout.blocks_x + x] = j.max[t];
+			total += j.sum[t];
+			if (j.max[t] > max)
+				max = j.max[t];
+			if (j.max[t] <= tolerance)
+				continue;
+			nr_diff++;
+			if (!quiet)
+				printf("%5u %5u %4u %7.2f\n", x * 4, y * 4,
+				       j.max[t], (double)j.sum[t] / j.tile_bytes);
+		}
+	}
+
+	printf("%u of %u tiles differ, max error %u, mean error %.4f\n",
+	       nr_diff, layout.blocks_x * layout.blocks_y, max,
+	       (double)total / ((size_t)layout.blocks_x * layout.blocks_y *
+				j.tile_bytes));
+
+	if (heat) {
+		struct image *img;
+		int fd;
+
+		fd = open(heatmap, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd == -1)
+			error(2, errno, "%s", heatmap);
+		img = image_open_pixel(fd, format, layout.blocks_x,
+				       layout.blocks_y, PIXEL_GREY8);
+		if (!img ||
+		    image_write(img, heat, layout.blocks_y, layout.blocks_x) ||
+		    image_close(img) || close(fd))
+			error(2, errno, "%s", heatmap);
+		free(heat);
+	}
+
+	free(j.max);
+	free(j.sum);
+	layout_fini(&layout);
+
+	return nr_diff ? 1 : 0;
+}
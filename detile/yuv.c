@@ -0,0 +1,402 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "image.h"
+#include "job.h"
+#include "tile.h"
+#include "yuv.h"
+
+static const char *const yuv_names[] = {
+	[YUV_YUY2] = "yuy2",
+	[YUV_NV12] = "nv12",
+	[YUV_I420] = "i420",
+};
+
+int yuv_format(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < sizeof(yuv_names) / sizeof(yuv_names[0]); i++)
+		if (!strcmp(name, yuv_names[i]))
+			return i;
+
+	return -1;
+}
+
+int yuv_frame_init(struct yuv_frame *f, enum yuv_format format,
+	unsigned int flags, unsigned int width, unsigned int height)
+{
+	/* Bytes per pixel and subsampling of each plane */
+	static const struct {
+		unsigned int nr_planes;
+		unsigned int ps[3];
+		unsigned int shift[3];
+	} planes[] = {
+		[YUV_YUY2] = { 1, { 2 }, { 0 } },
+		[YUV_NV12] = { 2, { 1, 2 }, { 0, 1 } },
+		[YUV_I420] = { 3, { 1, 1, 1 }, { 0, 1, 1 } },
+	};
+	unsigned int i;
+
+	memset(f, 0, sizeof(*f));
+
+	/* Chroma planes must be whole tiles as well */
+	if (width % 8 || height % 8) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	f->format = format;
+	f->width = width;
+	f->height = height;
+	f->nr_planes = planes[format].nr_planes;
+
+	for (i = 0; i < f->nr_planes; i++) {
+		unsigned int shift = planes[format].shift[i];
+		unsigned int ps = planes[format].ps[i];
+		struct layout *l = &f->layout[i];
+		size_t size;
+
+		if (layout_init(l, flags, ps, width >> shift, height >> shift))
+			goto fail;
+
+		f->offset[i] = f->size;
+		f->size += l->src_size;
+		f->stride[i] = (width >> shift) * ps;
+		size = f->stride[i] * (height >> shift);
+		f->plane[i] = malloc(size);
+		if (!f->plane[i])
+			goto fail;
+	}
+
+	return 0;
+
+fail:
+	yuv_frame_fini(f);
+	errno = ENOMEM;
+	return -1;
+}
+
+void yuv_frame_fini(struct yuv_frame *f)
+{
+	unsigned int i;
+
+	for (i = 0; i < 3; i++) {
+		layout_fini(&f->layout[i]);
+		free(f->plane[i]);
+		f->plane[i] = NULL;
+	}
+}
+
+void yuv_detile(struct yuv_frame *f, const void *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < f->nr_planes; i++)
+		detile(f->plane[i], src + f->offset[i], &f->layout[i]);
+}
+
+/*
+ * De-interleaving kernels.  @n counts output bytes per plane, and is
+ * always even.  YUY2 chroma is 4:2:2, and is averaged over each pair of
+ * lines to give 4:2:0.
+ */
+static void split_uv(uint8_t *u, uint8_t *v, const uint8_t *uv, unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi16(0xff);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(uv + 2 * i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(uv + 2 * i + 16));
+
+		_mm_storeu_si128((__m128i *)(u + i),
+			_mm_packus_epi16(_mm_and_si128(a, lo),
+					 _mm_and_si128(b, lo)));
+		_mm_storeu_si128((__m128i *)(v + i),
+			_mm_packus_epi16(_mm_srli_epi16(a, 8),
+					 _mm_srli_epi16(b, 8)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x2_t p = vld2q_u8(uv + 2 * i);
+
+		vst1q_u8(u + i, p.val[0]);
+		vst1q_u8(v + i, p.val[1]);
+	}
+#endif
+	for (; i < n; i++) {
+		u[i] = uv[2 * i];
+		v[i] = uv[2 * i + 1];
+	}
+}
+
+static void merge_uv(uint8_t *uv, const uint8_t *u, const uint8_t *v,
+	unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(u + i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(v + i));
+
+		_mm_storeu_si128((__m128i *)(uv + 2 * i),
+				 _mm_unpacklo_epi8(a, b));
+		_mm_storeu_si128((__m128i *)(uv + 2 * i + 16),
+				 _mm_unpackhi_epi8(a, b));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x2_t p = { { vld1q_u8(u + i), vld1q_u8(v + i) } };
+
+		vst2q_u8(uv + 2 * i, p);
+	}
+#endif
+	for (; i < n; i++) {
+		uv[2 * i] = u[i];
+		uv[2 * i + 1] = v[i];
+	}
+}
+
+static void yuyv_luma(uint8_t *y, const uint8_t *src, unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi16(0xff);
+
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i b = _mm_loadu_si128((const __m128i *)(src + 2 * i + 16));
+
+		_mm_storeu_si128((__m128i *)(y + i),
+			_mm_packus_epi16(_mm_and_si128(a, lo),
+					 _mm_and_si128(b, lo)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= n; i += 16)
+		vst1q_u8(y + i, vld2q_u8(src + 2 * i).val[0]);
+#endif
+	for (; i < n; i++)
+		y[i] = src[2 * i];
+}
+
+/* Interleaved UV of two lines of @n YUYV pixels, @n bytes of it */
+static void yuyv_chroma(uint8_t *uv, const uint8_t *src0, const uint8_t *src1,
+	unsigned int n)
+{
+	unsigned int i = 0;
+
+#if defined(__SSE2__)
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_avg_epu8(
+			_mm_loadu_si128((const __m128i *)(src0 + 2 * i)),
+			_mm_loadu_si128((const __m128i *)(src1 + 2 * i)));
+		__m128i b = _mm_avg_epu8(
+			_mm_loadu_si128((const __m128i *)(src0 + 2 * i + 16)),
+			_mm_loadu_si128((const __m128i *)(src1 + 2 * i + 16)));
+
+		_mm_storeu_si128((__m128i *)(uv + i),
+			_mm_packus_epi16(_mm_srli_epi16(a, 8),
+					 _mm_srli_epi16(b, 8)));
+	}
+#elif defined(__ARM_NEON)
+	for (; i + 16 <= n; i += 16)
+		vst1q_u8(uv + i, vrhaddq_u8(vld2q_u8(src0 + 2 * i).val[1],
+					    vld2q_u8(src1 + 2 * i).val[1]));
+#endif
+	for (; i < n; i++)
+		uv[i] = (src0[2 * i + 1] + src1[2 * i + 1] + 1) / 2;
+}
+
+/* Rows are pairs of lines, relative to the output planes */
+struct convert_job {
+	const struct yuv_frame *f;
+	enum yuv_format format;
+	uint8_t *y, *u, *v;
+};
+
+static void convert_job_rows(void *arg, unsigned int first, unsigned int num)
+{
+	struct convert_job *j = arg;
+	const struct yuv_frame *f = j->f;
+	unsigned int w = f->width, row, i;
+	uint8_t tmp[1024];
+
+	for (row = first; row < first + num; row++) {
+		uint8_t *y = j->y + 2 * row * w;
+		uint8_t *u = j->u + row * (w / 2);
+		uint8_t *v = j->v + row * (w / 2);
+		uint8_t *uv = j->u + row * w;
+
+		switch (f->format) {
+		case YUV_YUY2: {
+			const uint8_t *src0 = f->plane[0] + 2 * row * f->stride[0];
+			const uint8_t *src1 = src0 + f->stride[0];
+
+			yuyv_luma(y, src0, w);
+			yuyv_luma(y + w, src1, w);
+			if (j->format == YUV_NV12) {
+				yuyv_chroma(uv, src0, src1, w);
+				break;
+			}
+			for (i = 0; i < w; i += sizeof(tmp)) {
+				unsigned int n = w - i < sizeof(tmp) ?
+						 w - i : sizeof(tmp);
+
+				yuyv_chroma(tmp, src0 + 2 * i, src1 + 2 * i, n);
+				split_uv(u + i / 2, v + i / 2, tmp, n / 2);
+			}
+			break;
+		}
+		case YUV_NV12:
+			memcpy(y, f->plane[0] + 2 * row * w, 2 * w);
+			split_uv(u, v, f->plane[1] + row * w, w / 2);
+			break;
+		case YUV_I420:
+			memcpy(y, f->plane[0] + 2 * row * w, 2 * w);
+			merge_uv(uv, f->plane[1] + row * (w / 2),
+				 f->plane[2] + row * (w / 2), w / 2);
+			break;
+		}
+	}
+}
+
+/*
+ * Write the frame as @format, which is one of the 4:2:0 formats unless it
+ * is the format of the frame itself.
+ */
+int yuv_write(const struct yuv_frame *f, int fd, enum yuv_format format)
+{
+	size_t luma = (size_t)f->width * f->height, size;
+	struct convert_job j = {
+		.f = f,
+		.format = format,
+	};
+	uint8_t *buf;
+	unsigned int i;
+	int ret;
+
+	if (format == f->format) {
+		for (i = 0; i < f->nr_planes; i++) {
+			size = f->stride[i] * (f->height >> (i ? 1 : 0));
+			if (safe_write(fd, f->plane[i], size) != size)
+				return -1;
+		}
+		return 0;
+	}
+	if (format == YUV_YUY2) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	size = luma * 3 / 2;
+	buf = malloc(size);
+	if (!buf)
+		return -1;
+
+	j.y = buf;
+	j.u = buf + luma;
+	j.v = buf + luma + luma / 4;
+	run_job(convert_job_rows, &j, f->height / 2, (size_t)f->width * 6);
+
+	ret = safe_write(fd, buf, size) == size ? 0 : -1;
+	free(buf);
+
+	return ret;
+}
+
+static inline uint8_t clamp8(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+/* BT.601 limited range, 8 bits of fraction */
+static void yuv_to_rgbx(uint8_t *dst, const uint8_t *y, unsigned int ystep,
+	const uint8_t *u, const uint8_t *v, unsigned int cstep, unsigned int n)
+{
+	unsigned int x;
+
+	for (x = 0; x < n; x++, dst += 4) {
+		int c = 298 * (y[x * ystep] - 16) + 128;
+		int d = u[x / 2 * cstep] - 128;
+		int e = v[x / 2 * cstep] - 128;
+
+		dst[0] = clamp8((c + 409 * e) >> 8);
+		dst[1] = clamp8((c - 100 * d - 208 * e) >> 8);
+		dst[2] = clamp8((c + 516 * d) >> 8);
+		dst[3] = 255;
+	}
+}
+
+/* Rows are lines, relative to @first and @dst */
+struct rgb_job {
+	const struct yuv_frame *f;
+	unsigned int first;
+	uint8_t *dst;
+};
+
+static void rgb_job_rows(void *arg, unsigned int first, unsigned int num)
+{
+	struct rgb_job *j = arg;
+	const struct yuv_frame *f = j->f;
+	unsigned int line;
+
+	for (line = j->first + first; line < j->first + first + num; line++) {
+		uint8_t *dst = j->dst + (size_t)(line - j->first) * f->width * 4;
+		const uint8_t *y = f->plane[0] + line * f->stride[0];
+		const uint8_t *c = f->plane[f->nr_planes > 1] +
+				   (line / 2) * f->stride[1];
+
+		switch (f->format) {
+		case YUV_YUY2:
+			yuv_to_rgbx(dst, y, 2, y + 1, y + 3, 4, f->width);
+			break;
+		case YUV_NV12:
+			yuv_to_rgbx(dst, y, 1, c, c + 1, 2, f->width);
+			break;
+		case YUV_I420:
+			yuv_to_rgbx(dst, y, 1, c, f->plane[2] +
+				    (line / 2) * f->stride[2], 1, f->width);
+			break;
+		}
+	}
+}
+
+int yuv_write_image(const struct yuv_frame *f, struct image *img)
+{
+	size_t row_bytes = (size_t)f->width * 4;
+	unsigned int lines = CHUNK_BYTES * nr_threads / row_bytes;
+	struct rgb_job j = { .f = f };
+	int ret = 0;
+
+	if (lines == 0)
+		lines = 1;
+	j.dst = malloc(lines * row_bytes);
+	if (!j.dst)
+		return -1;
+
+	for (j.first = 0; j.first < f->height && !ret; j.first += lines) {
+		unsigned int n = f->height - j.first < lines ?
+				 f->height - j.first : lines;
+
+		run_job(rgb_job_rows, &j, n, row_bytes);
+		ret = image_write(img, j.dst, n, row_bytes);
+	}
+	free(j.dst);
+
+	return ret;
+}
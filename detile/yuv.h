@@ -0,0 +1,45 @@
+#ifndef YUV_H
+#define YUV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tile.h"
+
+struct image;
+
+/*
+ * Tiled YUV surfaces.  YUY2 render targets are a single plane of 2 byte
+ * YUYV pixel pairs, tiled like any 16bpp surface.  The YUV420 tiler
+ * writes 4:2:0 frames with each plane tiled on its own: a luma plane of
+ * 1 byte pixels, then either one half-size plane of 2 byte UV pairs
+ * (NV12) or separate half-size U and V planes of 1 byte pixels (I420).
+ * The planes follow each other in the tiled frame.
+ */
+enum yuv_format {
+	YUV_YUY2,
+	YUV_NV12,
+	YUV_I420,
+};
+
+struct yuv_frame {
+	enum yuv_format format;
+	unsigned int width;
+	unsigned int height;
+	unsigned int nr_planes;
+	struct layout layout[3];
+	size_t offset[3];	/* of each plane in the tiled frame */
+	size_t size;		/* of the tiled frame */
+	uint8_t *plane[3];	/* detiled planes */
+	size_t stride[3];
+};
+
+int yuv_format(const char *name);
+int yuv_frame_init(struct yuv_frame *f, enum yuv_format format,
+	unsigned int flags, unsigned int width, unsigned int height);
+void yuv_frame_fini(struct yuv_frame *f);
+void yuv_detile(struct yuv_frame *f, const void *src);
+int yuv_write(const struct yuv_frame *f, int fd, enum yuv_format format);
+int yuv_write_image(const struct yuv_frame *f, struct image *img);
+
+#endif
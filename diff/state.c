@@ -0,0 +1,101 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "hw/state.xml.h"
+#include "state.h"
+
+static inline void state_write(struct state *state, unsigned addr, uint32_t val)
+{
+	struct state_dirty *d = state->dirty;
+
+	state->state[addr] = val;
+	if (d && !d->set[addr]) {
+		d->set[addr] = 1;
+		d->addr[d->num++] = addr;
+	}
+}
+
+static void unknown_opcode(const uint32_t *word, size_t pos)
+{
+	fprintf(stderr, "Unknown opcode: %08x\n", word[0]);
+	fprintf(stderr, "Position: 0x%llx\n", (unsigned long long)pos * 4);
+	errno = EINVAL;
+}
+
+static int replay_op(void *priv, const struct vivcmd_op *op)
+{
+	struct state *state = priv;
+
+	switch (op->opcode) {
+	case VIVCMD_ZERO:
+	case VIVCMD_LOAD_STATE:
+	case VIVCMD_NOP:
+	case VIVCMD_STALL:
+	case VIVCMD_DRAW_PRIMITIVES:
+	case VIVCMD_DRAW_INDEXED_PRIMITIVES:
+		return 0;
+	case VIVCMD_END:
+		memset(state->state, 0xaa, sizeof(state->state));
+		if (state->dirty)
+			state->dirty->reset = 1;
+		return 0;
+	case VIVCMD_LINK:
+		/* Ends a kernel command buffer, back to the ring */
+		return -3;
+	default:
+		/* Flow control is not followed */
+		unknown_opcode(op->words, op->pos);
+		return -2;
+	}
+}
+
+static int replay_state(void *priv, uint32_t addr, const uint32_t *values,
+	unsigned int num)
+{
+	struct state *state = priv;
+	unsigned int i;
+
+	if (addr == VIVS_FE_VERTEX_ELEMENT_CONFIG(0) >> 2)
+		for (i = 0; i < 16; i++)
+			state_write(state, (0x600 >> 2) + i, 0);
+	for (i = 0; i < num; i++)
+		state_write(state, addr + i, values[i]);
+
+	return 0;
+}
+
+static int replay_draw(void *priv, const struct vivcmd_op *op)
+{
+	struct state *state = priv;
+
+	memcpy(state->draw_op, op->words, op->nr_words * sizeof(uint32_t));
+	if (op->opcode == VIVCMD_DRAW_PRIMITIVES)
+		state_write(state, VIVS_FE_INDEX_STREAM_CONTROL >> 2, 0);
+
+	return 1;
+}
+
+static const struct vivcmd_visitor replay = {
+	.op = replay_op,
+	.state = replay_state,
+	.draw = replay_draw,
+};
+
+/*
+ * Parse the command stream up to and including the next draw.  Returns
+ * 1 when a draw was found, 0 at the end of the stream or at a LINK, or
+ * -1 on error.
+ */
+int read_state(struct vivcmd_stream *s, struct state *state)
+{
+	int ret;
+
+	ret = vivcmd_parse(s, &replay, state);
+	if (ret == -1 && errno == EINVAL)
+		unknown_opcode(s->buf + s->pos, s->pos);
+	if (ret == -3)
+		return 0;
+
+	return ret < 0 ? -1 : ret;
+}
@@ -0,0 +1,44 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../cmd/vivcmd.h"
+
+enum {
+	MAX_STATE = (0xffff + 1) * 4,
+	NR_STATE_ADDR = 0xffff + 1,
+};
+
+/*
+ * Optional record of the state words written since the last draw.  An
+ * END resets every word, which sets @reset rather than listing them all.
+ */
+struct state_dirty {
+	uint8_t set[NR_STATE_ADDR];
+	uint32_t addr[NR_STATE_ADDR];
+	unsigned int num;
+	int reset;
+};
+
+struct state {
+	uint32_t state[MAX_STATE];
+	uint32_t draw_op[6];
+	struct state_dirty *dirty;
+};
+
+int read_state(struct vivcmd_stream *s, struct state *state);
+
+static inline void state_clear_dirty(struct state *state)
+{
+	struct state_dirty *d = state->dirty;
+	unsigned int i;
+
+	for (i = 0; i < d->num; i++)
+		d->set[d->addr[i]] = 0;
+	d->num = 0;
+	d->reset = 0;
+}
+
+#endif
@@ -3,14 +3,10 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
-#include <sys/fcntl.h>
-#include <unistd.h>
 
 #include "hw/state.xml.h"
-
-enum {
-	MAX_STATE = (0xffff + 1) * 4,
-};
+#include "state.h"
+#include "../stats/stats.h"
 
 static uint32_t address_states[] = {
 	VIVS_FE_INDEX_STREAM_BASE_ADDR,
@@ -23,108 +19,39 @@ static uint32_t address_states[] = {
 	0x1610,
 };
 
-struct state {
-	uint32_t state[MAX_STATE];
-	uint32_t draw_op[6];
-};
-
-static int read_state(int fd, struct state *state)
-{
-	uint32_t data[0x400];
-	uint32_t word[2];
-	unsigned num, addr, i;
-	int ret;
-
-	do {
-		ret = read(fd, word, sizeof(word));
-		if (ret <= 0)
-			return ret;
-		if (ret != sizeof(word))
-			return -1;
-
-		switch (word[0] >> 27) {
-		case 0:
-			break;
-		case 1: /* load state */
-			num = (word[0] >> 16) & 0x3ff;
-			addr = word[0] & 0xffff;
-			if (addr == VIVS_FE_VERTEX_ELEMENT_CONFIG(0) >> 2)
-				memset(&state->state[0x600 >> 2], 0, sizeof(uint32_t) * 16);
-			state->state[addr++] = word[1];
-			num--;
-			if (num) {
-				i = (num + 1) & ~1;
-				ret = read(fd, data, sizeof(uint32_t) * i);
-				if (ret <= 0)
-					return ret;
-				for (i = 0; i < num; i++)
-					state->state[addr++] = data[i];
-			}
-			break;
-		case 2:
-			memset(state->state, 0xaa, sizeof(state->state));
-			break;
-		case 3:
-		case 9:
-			break;
-
-		case 5:
-			ret = read(fd, data, sizeof(uint32_t) * 2);
-			if (ret <= 0)
-				return ret;
-			state->draw_op[0] = word[0];
-			state->draw_op[1] = word[1];
-			memcpy(&state->draw_op[2], data, sizeof(uint32_t) * 2);
-			state->state[VIVS_FE_INDEX_STREAM_CONTROL >> 2] = 0;
-			return 1;
-
-		case 6:
-			ret = read(fd, data, sizeof(uint32_t) * 4);
-			if (ret <= 0)
-				return ret;
-			state->draw_op[0] = word[0];
-			state->draw_op[1] = word[1];
-			memcpy(&state->draw_op[2], data, sizeof(uint32_t) * 4);
-			return 1;
-
-		default:
-			fprintf(stderr, "Unknown opcode: %08x\n", word[0]);
-			fprintf(stderr, "Position: 0x%llx\n",
-				(unsigned long long) lseek(fd, 0, SEEK_CUR));
-			return -1;
-		}
-	} while (1);
-}
-
 static int diff_files(const char *file1, const char *file2)
 {
-	struct state state[2];
+	static struct state state[2];
+	struct vivcmd_stream stream[2];
 	off_t pos[2], new_pos[2];
-	int fd[2];
+	int phase;
 
-	fd[0] = open(file1, O_RDONLY);
-	if (fd[0] == -1)
+	phase = stats_begin("map");
+	if (vivcmd_stream_open(&stream[0], file1))
 		error(1, errno, "%s", file1);
-	fd[1] = open(file2, O_RDONLY);
-	if (fd[1] == -1)
+	if (vivcmd_stream_open(&stream[1], file2))
 		error(1, errno, "%s", file2);
-
-	memset(state, 0, sizeof(state));
+	stats_end(phase, 0, 2);
 
 	do {
 		int i, ret;
 
+		phase = stats_begin("replay");
 		for (i = 0; i < 2; i++) {
-			pos[i] = lseek(fd[i], 0, SEEK_CUR);
-			if (pos[i] == (off_t)-1)
-				error(2, errno, "lseek");
-			ret = read_state(fd[i], &state[i]);
+			pos[i] = stream[i].pos * sizeof(uint32_t);
+			ret = read_state(&stream[i], &state[i]);
 			if (ret < 0)
 				error(2, errno, "read");
-			if (ret == 0)
+			if (ret == 0) {
+				stats_end(phase, stream[i].pos * sizeof(uint32_t) -
+					  pos[i], 0);
 				return 0;
-			new_pos[i] = lseek(fd[i], 0, SEEK_CUR);
+			}
+			new_pos[i] = stream[i].pos * sizeof(uint32_t);
 		}
+		stats_end(phase, new_pos[0] - pos[0] + new_pos[1] - pos[1], 1);
+
+		phase = stats_begin("compare");
 
 		for (i = 0; i < sizeof(address_states) / sizeof(uint32_t); i++) {
 			uint32_t idx = address_states[i] >> 2;
@@ -156,13 +83,15 @@ static int diff_files(const char *file1, const char *file2)
 			       file1, (unsigned long long)pos[0],
 			       file2, (unsigned long long)pos[1]);
 		}
+		stats_end(phase, 2 * sizeof(state[0].state), 1);
 	} while (1);
 }
 
 int main(int argc, char *argv[])
 {
+	stats_init(&argc, argv);
 	if (argc < 3) {
-		fprintf(stderr, "Usage: %s FILE1 FILE2\n", argv[0]);
+		fprintf(stderr, "Usage: %s [--stats] FILE1 FILE2\n", argv[0]);
 		return 1;
 	}
 
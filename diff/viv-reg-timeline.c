@@ -0,0 +1,412 @@
+/*
+ * Per-register change log of a command stream.
+ *
+ * Building walks the stream once with read_state() and, at each draw,
+ * appends every state word whose value changed since the previous draw
+ * to that register's columns.  After an END, which resets the state,
+ * every register logged so far is checked as well.  Each register has a
+ * draw column (LEB128 delta from the previous change) followed by a value
+ * column (LEB128 of the XOR with the previous value).  The resulting file
+ * is mmap()ed by the query side, which only ever decodes the registers
+ * asked for.
+ */
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "state.h"
+
+#define TL_MAGIC	"VIVTL001"
+
+struct tl_header {
+	char magic[8];
+	uint32_t nr_regs;
+	uint32_t nr_draws;
+	uint64_t data_size;
+};
+
+struct tl_reg {
+	uint32_t addr;		/* byte address of the state */
+	uint32_t nr_changes;
+	uint32_t first_draw;
+	uint32_t last_draw;
+	uint64_t draw_offset;	/* into the data area */
+	uint64_t value_offset;
+};
+
+struct column {
+	uint8_t *buf;
+	size_t len, alloc;
+};
+
+struct reg_log {
+	struct column draws;
+	struct column values;
+	uint32_t nr_changes;
+	uint32_t first_draw;
+	uint32_t last_draw;
+	uint32_t last_value;
+};
+
+static void column_put(struct column *c, uint32_t v)
+{
+	if (c->alloc - c->len < 5) {
+		c->alloc = c->alloc ? c->alloc * 2 : 64;
+		c->buf = realloc(c->buf, c->alloc);
+		if (!c->buf)
+			error(1, ENOMEM, "column");
+	}
+	while (v >= 0x80) {
+		c->buf[c->len++] = v | 0x80;
+		v >>= 7;
+	}
+	c->buf[c->len++] = v;
+}
+
+/* Decode one value into @v, failing at @end */
+static inline int column_get(const uint8_t **p, const uint8_t *end,
+	uint32_t *v)
+{
+	unsigned int shift = 0;
+	uint8_t b;
+
+	*v = 0;
+	do {
+		if (*p == end)
+			return -1;
+		b = *(*p)++;
+		*v |= (uint32_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+
+	return 0;
+}
+
+static int safe_write(int fd, const void *buf, size_t size)
+{
+	ssize_t ret;
+
+	while (size) {
+		ret = write(fd, buf, size);
+		if (ret == -1 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			return -1;
+		buf += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+/* Log @val for @addr at @draw, if it changed */
+static void log_change(struct reg_log **log, uint32_t addr, uint32_t val,
+	uint32_t draw)
+{
+	struct reg_log *l = log[addr];
+
+	if (!l) {
+		l = log[addr] = calloc(1, sizeof(*l));
+		if (!l)
+			error(1, ENOMEM, "register log");
+		l->first_draw = draw;
+	} else if (l->last_value == val) {
+		return;
+	}
+
+	column_put(&l->draws, draw - l->last_draw);
+	column_put(&l->values, val ^ l->last_value);
+	l->nr_changes++;
+	l->last_draw = draw;
+	l->last_value = val;
+}
+
+static int build(const char *in, const char *out)
+{
+	static struct state state;
+	static struct state_dirty dirty;
+	static struct reg_log *log[NR_STATE_ADDR];
+	struct vivcmd_stream stream;
+	struct tl_header hdr;
+	struct tl_reg reg;
+	uint64_t offset;
+	uint32_t draw, addr;
+	unsigned int i, nr_regs;
+	int ret, fd;
+
+	if (vivcmd_stream_open(&stream, in))
+		error(1, errno, "%s", in);
+
+	state.dirty = &dirty;
+
+	for (draw = 0; (ret = read_state(&stream, &state)) == 1; draw++) {
+		if (dirty.reset)
+			for (addr = 0; addr < NR_STATE_ADDR; addr++)
+				if (log[addr])
+					log_change(log, addr, state.state[addr],
+						   draw);
+		for (i = 0; i < dirty.num; i++) {
+			addr = dirty.addr[i];
+			log_change(log, addr, state.state[addr], draw);
+		}
+		state_clear_dirty(&state);
+	}
+	if (ret < 0)
+		error(2, errno, "%s: offset 0x%llx", in,
+		      (unsigned long long)stream.pos * 4);
+	vivcmd_stream_close(&stream);
+
+	for (nr_regs = addr = 0; addr < NR_STATE_ADDR; addr++)
+		if (log[addr])
+			nr_regs++;
+
+	fd = open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1)
+		error(1, errno, "%s", out);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TL_MAGIC, sizeof(hdr.magic));
+	hdr.nr_regs = nr_regs;
+	hdr.nr_draws = draw;
+	for (addr = 0; addr < NR_STATE_ADDR; addr++)
+		if (log[addr])
+			hdr.data_size += log[addr]->draws.len +
+					 log[addr]->values.len;
+	if (safe_write(fd, &hdr, sizeof(hdr)))
+		error(1, errno, "%s", out);
+
+	for (offset = addr = 0; addr < NR_STATE_ADDR; addr++) {
+		struct reg_log *l = log[addr];
+
+		if (!l)
+			continue;
+
+		reg.addr = addr << 2;
+		reg.nr_changes = l->nr_changes;
+		reg.first_draw = l->first_draw;
+		reg.last_draw = l->last_draw;
+		reg.draw_offset = offset;
+		reg.value_offset = offset + l->draws.len;
+		offset += l->draws.len + l->values.len;
+		if (safe_write(fd, &reg, sizeof(reg)))
+			error(1, errno, "%s", out);
+	}
+
+	for (addr = 0; addr < NR_STATE_ADDR; addr++) {
+		struct reg_log *l = log[addr];
+
+		if (!l)
+			continue;
+
+		if (safe_write(fd, l->draws.buf, l->draws.len) ||
+		    safe_write(fd, l->values.buf, l->values.len))
+			error(1, errno, "%s", out);
+		free(l->draws.buf);
+		free(l->values.buf);
+		free(l);
+	}
+
+	if (close(fd))
+		error(1, errno, "%s", out);
+
+	fprintf(stderr, "%u draws, %u registers, %llu bytes of change data\n",
+		hdr.nr_draws, hdr.nr_regs, (unsigned long long)hdr.data_size);
+
+	return 0;
+}
+
+struct timeline {
+	const struct tl_header *hdr;
+	const struct tl_reg *regs;
+	const uint8_t *data;
+	size_t size;
+};
+
+static void timeline_open(struct timeline *tl, const char *name)
+{
+	const struct tl_reg *reg;
+	uint64_t head, data_size;
+	struct stat st;
+	unsigned int i;
+	void *ptr;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		error(1, errno, "%s", name);
+	if (fstat(fd, &st) == -1)
+		error(1, errno, "%s", name);
+	if (st.st_size < sizeof(struct tl_header))
+		error(1, 0, "%s: not a timeline file", name);
+
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == (void *)-1)
+		error(1, errno, "%s: mmap", name);
+	close(fd);
+
+	tl->hdr = ptr;
+	tl->regs = ptr + sizeof(*tl->hdr);
+	tl->size = st.st_size;
+
+	head = sizeof(*tl->hdr) + (uint64_t)tl->hdr->nr_regs * sizeof(*reg);
+	data_size = tl->hdr->data_size;
+	if (memcmp(tl->hdr->magic, TL_MAGIC, sizeof(tl->hdr->magic)) ||
+	    head > tl->size || data_size > tl->size - head)
+		error(1, 0, "%s: not a timeline file", name);
+	tl->data = ptr + head;
+
+	/* Each change takes at least a byte in each column */
+	for (i = 0; i < tl->hdr->nr_regs; i++) {
+		reg = &tl->regs[i];
+		if (reg->draw_offset > reg->value_offset ||
+		    reg->value_offset > data_size ||
+		    reg->nr_changes > reg->value_offset - reg->draw_offset ||
+		    reg->nr_changes > data_size - reg->value_offset)
+			error(1, 0, "%s: register %05x: bad change data",
+			      name, reg->addr);
+	}
+}
+
+static const struct tl_reg *timeline_find(const struct timeline *tl,
+	uint32_t addr)
+{
+	unsigned int lo = 0, hi = tl->hdr->nr_regs;
+
+	while (lo < hi) {
+		unsigned int mid = (lo + hi) / 2;
+
+		if (tl->regs[mid].addr == addr)
+			return &tl->regs[mid];
+		if (tl->regs[mid].addr < addr)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+/*
+ * Print the changes of one register within draws [first, last].  With
+ * @in_effect, the value the register held going into @first is printed
+ * as well, so a single-register query is self-contained.
+ */
+static void show_reg(const struct timeline *tl, const struct tl_reg *reg,
+	uint32_t first, uint32_t last, int in_effect)
+{
+	const uint8_t *dp = tl->data + reg->draw_offset;
+	const uint8_t *vp = tl->data + reg->value_offset;
+	const uint8_t *draws_end = vp;
+	const uint8_t *values_end = tl->data + tl->hdr->data_size;
+	uint32_t draw = 0, val = 0, delta, bits, i;
+
+	if (reg->first_draw > last || (reg->last_draw < first && !in_effect))
+		return;
+
+	for (i = 0; i < reg->nr_changes; i++) {
+		uint32_t prev = val;
+
+		if (column_get(&dp, draws_end, &delta) ||
+		    column_get(&vp, values_end, &bits))
+			error(1, 0, "register %05x: bad change data",
+			      reg->addr);
+		draw += delta;
+		val ^= bits;
+
+		if (draw < first)
+			continue;
+		if (i && in_effect)
+			printf("%8s %05x = %08x\n", "before", reg->addr, prev);
+		in_effect = 0;
+		if (draw > last)
+			return;
+		printf("%8u %05x = %08x\n", draw, reg->addr, val);
+	}
+
+	if (in_effect)
+		printf("%8s %05x = %08x\n", "before", reg->addr, val);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s -o TIMELINE CMDFILE\n"
+		"       %s [-r REG]... [-d FIRST[-LAST]] TIMELINE\n",
+		prog, prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	const char *out = NULL;
+	struct timeline tl;
+	uint32_t regs[64], first = 0, last = UINT32_MAX;
+	unsigned int nr_regs = 0, i;
+	char *end;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "o:r:d:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out = optarg;
+			break;
+		case 'r':
+			if (nr_regs == sizeof(regs) / sizeof(regs[0]))
+				usage(argv[0]);
+			regs[nr_regs++] = strtoul(optarg, NULL, 16) & ~3;
+			break;
+		case 'd':
+			first = strtoul(optarg, &end, 0);
+			last = first;
+			if (*end == '-')
+				last = *++end ? strtoul(end, NULL, 0) : UINT32_MAX;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	if (out)
+		return build(argv[optind], out);
+
+	timeline_open(&tl, argv[optind]);
+
+	if (nr_regs == 0 && first == 0 && last == UINT32_MAX) {
+		printf("%u draws, %u registers\n",
+		       tl.hdr->nr_draws, tl.hdr->nr_regs);
+		printf("%-5s %8s %8s %8s\n", "Reg", "Changes", "First", "Last");
+		for (i = 0; i < tl.hdr->nr_regs; i++)
+			printf("%05x %8u %8u %8u\n", tl.regs[i].addr,
+			       tl.regs[i].nr_changes, tl.regs[i].first_draw,
+			       tl.regs[i].last_draw);
+		return 0;
+	}
+
+	if (nr_regs) {
+		for (i = 0; i < nr_regs; i++) {
+			const struct tl_reg *reg = timeline_find(&tl, regs[i]);
+
+			if (!reg) {
+				fprintf(stderr, "%05x: never written\n", regs[i]);
+				continue;
+			}
+			show_reg(&tl, reg, first, last, 1);
+		}
+	} else {
+		for (i = 0; i < tl.hdr->nr_regs; i++)
+			show_reg(&tl, &tl.regs[i], first, last, 0);
+	}
+
+	return 0;
+}
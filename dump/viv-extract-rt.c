@@ -0,0 +1,517 @@
+/*
+ * Extract the render targets of a devcoredump as images.
+ *
+ * The command buffers in the dump are replayed with read_state(), and at
+ * every draw the bound colour and depth surfaces are noted from the PE
+ * and TS state.  Each surface is then found in the dump's buffers by its
+ * GPU address and detiled, all surfaces in parallel.
+ *
+ * The PE state only gives the stride, so the width is the padded width.
+ * The height comes from the distance to the second pipe's half for
+ * multi-pipe surfaces, or else from the end of the buffer holding the
+ * surface, and is cut down to the viewport where one is set.
+ *
+ * Multisampled colour surfaces with 8-bit channels are box-resolved;
+ * other multisampled surfaces are written as their first sample.
+ *
+ * The chip, when the dump's registers identify it, gives the tile status
+ * bits per tile and whether a second pipe address can be in use.
+ */
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "etnaviv_dump.h"
+#include "hw/common.xml.h"
+#include "hw/state_3d.xml.h"
+#include "../diff/state.h"
+#include "../detile/image.h"
+#include "../detile/job.h"
+#include "../detile/tile.h"
+#include "../info/chipdb.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+#define STATE(s, reg)	((s)->state[(reg) >> 2])
+
+struct dump {
+	const void *file;
+	size_t size;
+	const struct etnaviv_dump_object_header *hdr;
+	unsigned int nr_bufs;
+};
+
+struct surface {
+	const char *kind;
+	uint32_t addr;
+	uint32_t pipe_addr;		/* of the lower half, if multi-pipe */
+	uint32_t stride;
+	unsigned int fmt;
+	enum image_pixel pixel;
+	unsigned int flags;
+	unsigned int vp_width, vp_height;
+	unsigned int samples;
+	uint32_t ts_addr;
+	uint32_t clear;
+
+	/* Filled in by the extraction */
+	unsigned int width, height;
+	char name[256];
+	const char *err;
+	int errnum;
+};
+
+static const struct {
+	const char *name;
+	enum image_pixel pixel;
+} color_formats[] = {
+	[RS_FORMAT_X4R4G4B4] = { "X4R4G4B4", PIXEL_X4R4G4B4 },
+	[RS_FORMAT_A4R4G4B4] = { "A4R4G4B4", PIXEL_A4R4G4B4 },
+	[RS_FORMAT_X1R5G5B5] = { "X1R5G5B5", PIXEL_X1R5G5B5 },
+	[RS_FORMAT_A1R5G5B5] = { "A1R5G5B5", PIXEL_A1R5G5B5 },
+	[RS_FORMAT_R5G6B5] = { "R5G6B5", PIXEL_R5G6B5 },
+	[RS_FORMAT_X8R8G8B8] = { "X8R8G8B8", PIXEL_X8R8G8B8 },
+	[RS_FORMAT_A8R8G8B8] = { "A8R8G8B8", PIXEL_A8R8G8B8 },
+};
+
+static const char *const extensions[] = {
+	[IMAGE_RAW] = "bin",
+	[IMAGE_PPM] = "ppm",
+	[IMAGE_PAM] = "pam",
+	[IMAGE_PNG] = "png",
+};
+
+static struct surface *surfaces;
+static unsigned int nr_surfaces, max_surfaces;
+static const struct dump *dump;
+static const char *out_dir = ".";
+static enum image_format out_format = IMAGE_PNG;
+static unsigned int ts_bits;
+static struct chip chip;
+
+static void dump_open(struct dump *d, const char *name)
+{
+	struct stat st;
+	unsigned int i;
+	void *ptr;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		error(1, errno, "%s", name);
+	if (fstat(fd, &st) == -1)
+		error(1, errno, "%s", name);
+
+	ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (ptr == (void *)-1)
+		error(1, errno, "%s: mmap", name);
+	close(fd);
+
+	d->file = ptr;
+	d->size = st.st_size;
+	d->hdr = ptr;
+
+	for (i = 0; (i + 1) * sizeof(*d->hdr) <= d->size &&
+	     d->hdr[i].magic == ETDUMP_MAGIC; i++) {
+		if (d->hdr[i].type == ETDUMP_BUF_END)
+			break;
+		if (d->hdr[i].file_offset + (size_t)d->hdr[i].file_size >
+		    d->size)
+			error(2, 0, "%s: buffer %u is truncated", name, i);
+	}
+	if ((i + 1) * sizeof(*d->hdr) > d->size ||
+	    d->hdr[i].magic != ETDUMP_MAGIC)
+		error(2, 0, "%s: invalid dump file", name);
+	d->nr_bufs = i;
+}
+
+static void dump_chip(const struct dump *d, struct chip *chip)
+{
+	unsigned int i;
+
+	for (i = 0; i < d->nr_bufs; i++) {
+		const struct etnaviv_dump_object_header *h = &d->hdr[i];
+
+		if (h->type == ETDUMP_BUF_REG &&
+		    !chip_from_registers(chip, d->file + h->file_offset,
+					 h->file_size / sizeof(struct etnaviv_dump_registers)))
+			return;
+	}
+
+	memset(chip, 0, sizeof(*chip));
+}
+
+/* Find the buffer holding GPU address @addr */
+static const void *dump_find(const struct dump *d, uint32_t addr,
+	size_t *size)
+{
+	unsigned int i;
+
+	for (i = 0; i < d->nr_bufs; i++) {
+		const struct etnaviv_dump_object_header *h = &d->hdr[i];
+
+		if (h->type == ETDUMP_BUF_REG || h->type == ETDUMP_BUF_MMU ||
+		    h->type == ETDUMP_BUF_BOMAP || h->iova == 0)
+			continue;
+		if (addr >= h->iova && addr - h->iova < h->file_size) {
+			*size = h->file_size - (addr - h->iova);
+			return d->file + h->file_offset + (addr - h->iova);
+		}
+	}
+
+	return NULL;
+}
+
+static void add_surface(const struct surface *s)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_surfaces; i++)
+		if (surfaces[i].addr == s->addr &&
+		    !strcmp(surfaces[i].kind, s->kind))
+			break;
+
+	if (i == max_surfaces) {
+		max_surfaces = max_surfaces ? max_surfaces * 2 : 16;
+		surfaces = realloc(surfaces, max_surfaces * sizeof(*s));
+		if (!surfaces)
+			error(1, ENOMEM, "surfaces");
+	}
+	if (i == nr_surfaces)
+		nr_surfaces++;
+
+	/* The last state a surface was drawn with wins */
+	surfaces[i] = *s;
+}
+
+static float state_float(const struct state *st, uint32_t reg)
+{
+	union {
+		uint32_t u;
+		float f;
+	} v = { .u = STATE(st, reg) };
+
+	return isfinite(v.f) ? fabsf(v.f) : 0;
+}
+
+/*
+ * Note the colour and depth surfaces bound at a draw.  Cores with two
+ * pixel pipes have an address for each pipe's half of the surface.
+ */
+static void note_surfaces(const struct state *st)
+{
+	uint32_t ts_config = STATE(st, VIVS_TS_MEM_CONFIG);
+	uint32_t cfg;
+	struct surface s;
+
+	memset(&s, 0, sizeof(s));
+	s.vp_width = lrintf(2 * state_float(st, VIVS_PA_VIEWPORT_SCALE_X));
+	s.vp_height = lrintf(2 * state_float(st, VIVS_PA_VIEWPORT_SCALE_Y));
+	switch (STATE(st, VIVS_GL_MULTI_SAMPLE_CONFIG) &
+		VIVS_GL_MULTI_SAMPLE_CONFIG_MSAA_SAMPLES__MASK) {
+	case VIVS_GL_MULTI_SAMPLE_CONFIG_MSAA_SAMPLES_2X:
+		s.samples = 2;
+		break;
+	case VIVS_GL_MULTI_SAMPLE_CONFIG_MSAA_SAMPLES_4X:
+		s.samples = 4;
+		break;
+	}
+
+	cfg = STATE(st, VIVS_PE_COLOR_FORMAT);
+	s.kind = "color";
+	s.addr = STATE(st, VIVS_PE_COLOR_ADDR);
+	s.pipe_addr = STATE(st, VIVS_PE_PIPE_COLOR_ADDR(1));
+	if (!s.addr)
+		s.addr = STATE(st, VIVS_PE_PIPE_COLOR_ADDR(0));
+	s.stride = STATE(st, VIVS_PE_COLOR_STRIDE);
+	s.fmt = cfg & VIVS_PE_COLOR_FORMAT_FORMAT__MASK;
+	s.flags = cfg & VIVS_PE_COLOR_FORMAT_SUPER_TILED ? LAYOUT_SUPER : 0;
+	if ((ts_config & VIVS_TS_MEM_CONFIG_COLOR_FAST_CLEAR) &&
+	    STATE(st, VIVS_TS_COLOR_SURFACE_BASE) == s.addr) {
+		s.ts_addr = STATE(st, VIVS_TS_COLOR_STATUS_BASE);
+		s.clear = STATE(st, VIVS_TS_COLOR_CLEAR_VALUE);
+	}
+	if (s.addr && s.stride && s.fmt < ARRAY_SIZE(color_formats) &&
+	    color_formats[s.fmt].name) {
+		s.pixel = color_formats[s.fmt].pixel;
+		add_surface(&s);
+	}
+
+	cfg = STATE(st, VIVS_PE_DEPTH_CONFIG);
+	s.kind = "depth";
+	s.addr = STATE(st, VIVS_PE_DEPTH_ADDR);
+	s.pipe_addr = STATE(st, VIVS_PE_PIPE_DEPTH_ADDR(1));
+	if (!s.addr)
+		s.addr = STATE(st, VIVS_PE_PIPE_DEPTH_ADDR(0));
+	s.stride = STATE(st, VIVS_PE_DEPTH_STRIDE);
+	s.fmt = cfg & VIVS_PE_DEPTH_CONFIG_DEPTH_FORMAT__MASK;
+	s.flags = cfg & VIVS_PE_DEPTH_CONFIG_SUPER_TILED ? LAYOUT_SUPER : 0;
+	s.pixel = s.fmt == VIVS_PE_DEPTH_CONFIG_DEPTH_FORMAT_D16 ?
+		  PIXEL_D16 : PIXEL_D24S8;
+	s.ts_addr = 0;
+	s.clear = 0;
+	if ((ts_config & VIVS_TS_MEM_CONFIG_DEPTH_FAST_CLEAR) &&
+	    STATE(st, VIVS_TS_DEPTH_SURFACE_BASE) == s.addr) {
+		s.ts_addr = STATE(st, VIVS_TS_DEPTH_STATUS_BASE);
+		s.clear = STATE(st, VIVS_TS_DEPTH_CLEAR_VALUE);
+	}
+	if (s.addr && s.stride)
+		add_surface(&s);
+}
+
+static void replay(const struct dump *d)
+{
+	static struct state st;
+	unsigned int i, draws = 0;
+
+	for (i = 0; i < d->nr_bufs; i++) {
+		const struct etnaviv_dump_object_header *h = &d->hdr[i];
+		struct vivcmd_stream stream = {
+			.buf = d->file + h->file_offset,
+			.size = h->file_size / sizeof(uint32_t),
+		};
+
+		if (h->type != ETDUMP_BUF_CMD || h->iova == 0)
+			continue;
+
+		/* The closing LINK, or anything unknown, ends the buffer */
+		while (read_state(&stream, &st) == 1) {
+			note_surfaces(&st);
+			draws++;
+		}
+	}
+
+	fprintf(stderr, "%u draws, %u surfaces\n", draws, nr_surfaces);
+}
+
+static unsigned int align(unsigned int v, unsigned int a)
+{
+	return (v + a - 1) / a * a;
+}
+
+static int extract(struct surface *s)
+{
+	unsigned int cpp = image_pixel_size(s->pixel);
+	unsigned int align_x = 1, align_y = 1, width, height;
+	struct tile_status ts, *tsp = NULL;
+	struct msaa msaa = { .samples = s->samples, .sample = -1 };
+	unsigned int msaa_x = 1, msaa_y = 1;
+	struct layout layout;
+	struct input in;
+	struct image *img;
+	const void *ptr, *ts_ptr;
+	size_t size, pipe_size, ts_size;
+	int fd, ret;
+
+	ptr = dump_find(dump, s->addr, &size);
+	if (!ptr) {
+		s->err = "not in the dump";
+		return -1;
+	}
+
+	/* The second pipe's half must follow in the same buffer */
+	if (s->pipe_addr > s->addr && chip.pixel_pipes != 1) {
+		size_t half = s->pipe_addr - s->addr;
+
+		if (half > size / 2 ||
+		    dump_find(dump, s->pipe_addr, &pipe_size) !=
+		    (const char *)ptr + half) {
+			s->err = "does not fit its buffer";
+			return -1;
+		}
+		s->flags |= LAYOUT_MULTI;
+		size = 2 * half;
+	}
+	if (s->flags & LAYOUT_MULTI) {
+		align_x = 4;
+		align_y = 2;
+	}
+	if (s->flags & LAYOUT_SUPER) {
+		align_x = 16;
+		align_y *= 16;
+	}
+
+	/* The surface as far as its buffer, or second half, allows */
+	s->width = s->stride / cpp & ~3;
+	width = align(s->width / 4, align_x) * 4;
+	height = size / ((size_t)width * cpp) / (4 * align_y) * (4 * align_y);
+	s->height = height;
+	if (s->vp_height && s->vp_height < height) {
+		s->height = s->vp_height;
+		if (!(s->flags & LAYOUT_MULTI))
+			height = align(s->height, 4 * align_y);
+	}
+	if (!s->width || !s->height) {
+		s->err = "empty";
+		return -1;
+	}
+
+	if (layout_init(&layout, s->flags, cpp, s->width, height)) {
+		s->errnum = errno;
+		return -1;
+	}
+	if (layout.src_size > size ||
+	    (s->flags & LAYOUT_MULTI &&
+	     layout.half_size != s->pipe_addr - s->addr)) {
+		s->err = "does not fit its buffer";
+		layout_fini(&layout);
+		return -1;
+	}
+
+	if (s->ts_addr) {
+		ts_ptr = dump_find(dump, s->ts_addr, &ts_size);
+		if (ts_ptr) {
+			tile_status_init(&ts, ts_ptr, ts_size, ts_bits,
+					 s->clear);
+			tsp = &ts;
+		}
+	}
+
+	snprintf(s->name, sizeof(s->name), "%s/%s-%08x.%s", out_dir, s->kind,
+		 s->addr, extensions[out_format]);
+	fd = open(s->name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd == -1) {
+		s->errnum = errno;
+		layout_fini(&layout);
+		return -1;
+	}
+
+	if (s->samples) {
+		msaa_x = 2;
+		msaa_y = s->samples / 2;
+		if (s->pixel != PIXEL_X8R8G8B8 && s->pixel != PIXEL_A8R8G8B8)
+			msaa.sample = 0;
+	}
+
+	if (out_format == IMAGE_RAW)
+		img = image_open(fd, out_format, s->width / msaa_x,
+				 s->height / msaa_y, cpp);
+	else
+		img = image_open_pixel(fd, out_format,
+				       (s->vp_width && s->vp_width < s->width ?
+					s->vp_width : s->width) / msaa_x,
+				       s->height / msaa_y, s->pixel);
+	if (!img) {
+		s->errnum = errno;
+		close(fd);
+		layout_fini(&layout);
+		return -1;
+	}
+
+	in.fd = -1;
+	in.map = ptr;
+	in.size = layout.src_size;
+	in.pos = 0;
+	in.bytes = 0;
+	in.rows = 0;
+	ret = stream_detile(&in, img, &layout, tsp,
+			    s->samples ? &msaa : NULL, 0);
+	if (image_close(img))
+		ret = -1;
+	if (close(fd))
+		ret = -1;
+	if (ret)
+		s->errnum = errno;
+	layout_fini(&layout);
+
+	return ret;
+}
+
+static void extract_job(void *arg, unsigned int first, unsigned int num)
+{
+	unsigned int i;
+
+	for (i = first; i < first + num; i++)
+		extract(&surfaces[i]);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [-o DIR] [-f raw|ppm|pam|png] [-B TS_BITS] [-j THREADS] DUMPFILE\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct dump d;
+	unsigned int i;
+	int opt, ret = 0;
+
+	detile_init();
+	job_set_threads(0);
+
+	while ((opt = getopt(argc, argv, "o:f:B:j:")) != -1) {
+		switch (opt) {
+		case 'o':
+			out_dir = optarg;
+			break;
+		case 'f':
+			if (image_format(optarg) < 0)
+				usage(argv[0]);
+			out_format = image_format(optarg);
+			break;
+		case 'B':
+			ts_bits = strtoul(optarg, NULL, 10);
+			if (ts_bits != 2 && ts_bits != 4)
+				usage(argv[0]);
+			break;
+		case 'j':
+			job_set_threads(strtoul(optarg, NULL, 10));
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	dump_open(&d, argv[optind]);
+	dump = &d;
+
+	dump_chip(&d, &chip);
+	if (chip.model)
+		fprintf(stderr, "GC%x rev 0x%04x\n", chip.model, chip.revision);
+	if (!ts_bits && chip.known & (1 << CHIP_MINOR_FEATURES0))
+		ts_bits = chip_has(&chip, CHIP_MINOR_FEATURES0,
+				   chipMinorFeatures0_2BITPERTILE) ? 2 : 4;
+	if (!ts_bits)
+		ts_bits = 2;
+
+	replay(&d);
+
+	run_job(extract_job, NULL, nr_surfaces, 0);
+
+	for (i = 0; i < nr_surfaces; i++) {
+		const struct surface *s = &surfaces[i];
+
+		printf("%-5s %08x %-8s %5ux%-5u%s%s%s", s->kind, s->addr,
+		       !strcmp(s->kind, "depth") ?
+		       (s->pixel == PIXEL_D16 ? "D16" : "D24S8") :
+		       color_formats[s->fmt].name, s->width, s->height,
+		       s->flags & LAYOUT_MULTI ? " multi" : "",
+		       s->flags & LAYOUT_SUPER ? " super" : "",
+		       s->ts_addr ? " ts" : "");
+		if (s->samples)
+			printf(" %ux", s->samples);
+		printf(" ");
+		if (s->err || s->errnum) {
+			printf("failed: %s\n",
+			       s->err ? s->err : strerror(s->errnum));
+			ret = 1;
+		} else {
+			printf("%s\n", s->name);
+		}
+	}
+
+	return ret;
+}
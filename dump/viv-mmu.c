@@ -0,0 +1,450 @@
+/*
+ * Decode the MMUv1 page table of a devcoredump, or an mmu.bin written by
+ * viv-unpack, into ranges.
+ *
+ * Each entry is the physical address of one 4K page, the first entry
+ * mapping BASE.  Pages that are physically contiguous as well are
+ * coalesced into one range.  The kernel points every unmapped entry at
+ * one scratch page, so the value of the longest run of equal entries is
+ * taken as the scratch page, unless given with -B; a zero entry is
+ * unmapped as well.  An entry that is not page aligned is invalid.
+ *
+ * The summary gives the fragmentation of the address space: the number
+ * and sizes of the physically contiguous ranges as a histogram by powers
+ * of two, the mapped areas of IOVA, and the holes between them, with the
+ * external fragmentation 1 - largest hole / unmapped space.
+ */
+#include <errno.h>
+#include <error.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "etnaviv_dump.h"
+#include "../stats/stats.h"
+
+#define PAGE_SIZE	4096u
+#define MMUV1_BASE	0x80000000u
+#define NR_BUCKETS	32
+
+enum {
+	OUT_TEXT,
+	OUT_JSON,
+};
+
+enum range_kind {
+	RANGE_MAPPED,
+	RANGE_UNMAPPED,
+	RANGE_INVALID,
+};
+
+struct range {
+	enum range_kind kind;
+	size_t first;
+	size_t pages;
+	uint32_t phys;
+};
+
+struct mmu_stats {
+	size_t entries;
+	size_t mapped;
+	size_t unmapped;
+	size_t invalid;
+	size_t ranges;
+	size_t largest_range;
+	size_t areas;
+	size_t largest_area;
+	size_t holes;
+	size_t largest_hole;
+	size_t buckets[NR_BUCKETS];
+};
+
+/*
+ * Number of entries from @e on, at most @n, that continue e[0] in steps
+ * of @step: physically contiguous pages for PAGE_SIZE, or equal entries
+ * for 0.
+ */
+#if defined(__SSE2__)
+static size_t run_length(const uint32_t *e, size_t n, uint32_t step)
+{
+	__m128i expect = _mm_add_epi32(_mm_set1_epi32(e[0]),
+				       _mm_set_epi32(3 * step, 2 * step,
+						     step, 0));
+	__m128i inc = _mm_set1_epi32(4 * step);
+	uint32_t next;
+	size_t i;
+	int mask;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(e + i));
+
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi32(v, expect));
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask) / 4;
+		expect = _mm_add_epi32(expect, inc);
+	}
+
+	for (next = e[0] + i * step; i < n && e[i] == next; i++)
+		next += step;
+	return i;
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+static size_t run_length(const uint32_t *e, size_t n, uint32_t step)
+{
+	static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+	uint32x4_t expect = vmlaq_n_u32(vdupq_n_u32(e[0]), vld1q_u32(lanes),
+					step);
+	uint32x4_t inc = vdupq_n_u32(4 * step);
+	uint32_t next;
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		if (vminvq_u32(vceqq_u32(vld1q_u32(e + i), expect)) != ~0u)
+			break;
+		expect = vaddq_u32(expect, inc);
+	}
+
+	for (next = e[0] + i * step; i < n && e[i] == next; i++)
+		next += step;
+	return i;
+}
+#else
+static size_t run_length(const uint32_t *e, size_t n, uint32_t step)
+{
+	uint32_t next = e[0];
+	size_t i;
+
+	for (i = 0; i < n && e[i] == next; i++)
+		next += step;
+	return i;
+}
+#endif
+
+/* The value of the longest run of at least two equal entries, or 0 */
+static uint32_t find_scratch(const uint32_t *e, size_t n)
+{
+	size_t i, len, best = 1;
+	uint32_t scratch = 0;
+
+	for (i = 0; i < n; i += len) {
+		len = run_length(e + i, n - i, 0);
+		if (len > best) {
+			best = len;
+			scratch = e[i];
+		}
+	}
+
+	return scratch;
+}
+
+static const uint32_t *open_table(const char *name, size_t *entries)
+{
+	const struct etnaviv_dump_object_header *hdr;
+	struct stat st;
+	void *file;
+	size_t i;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd == -1)
+		error(1, errno, "%s", name);
+	if (fstat(fd, &st) == -1)
+		error(1, errno, "%s", name);
+	if (st.st_size < sizeof(uint32_t))
+		error(2, 0, "%s: empty", name);
+
+	file = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (file == (void *)-1)
+		error(1, errno, "%s: mmap", name);
+	close(fd);
+
+	hdr = file;
+	if (hdr[0].magic != ETDUMP_MAGIC) {
+		madvise(file, st.st_size, MADV_SEQUENTIAL);
+		*entries = st.st_size / sizeof(uint32_t);
+		return file;
+	}
+
+	for (i = 0; (i + 1) * sizeof(*hdr) <= st.st_size &&
+	     hdr[i].magic == ETDUMP_MAGIC &&
+	     hdr[i].type != ETDUMP_BUF_END; i++) {
+		if (hdr[i].type != ETDUMP_BUF_MMU)
+			continue;
+		if (hdr[i].file_offset + (size_t)hdr[i].file_size > st.st_size)
+			error(2, 0, "%s: MMU buffer is truncated", name);
+		*entries = hdr[i].file_size / sizeof(uint32_t);
+		return file + hdr[i].file_offset;
+	}
+
+	error(2, 0, "%s: no MMU buffer", name);
+	return NULL;
+}
+
+static void print_range(const struct range *r, uint64_t base, int format,
+	int first)
+{
+	uint64_t iova = base + (uint64_t)r->first * PAGE_SIZE;
+	uint64_t size = (uint64_t)r->pages * PAGE_SIZE;
+
+	if (format == OUT_JSON) {
+		printf("%s\n    {\"iova\":%llu,\"pages\":%zu,", first ? "" : ",",
+		       (unsigned long long)iova, r->pages);
+		if (r->kind == RANGE_MAPPED)
+			printf("\"phys\":%u}", r->phys);
+		else
+			printf("\"%s\":true}", r->kind == RANGE_UNMAPPED ?
+			       "unmapped" : "invalid");
+		return;
+	}
+
+	printf("%09llx-%09llx ", (unsigned long long)iova,
+	       (unsigned long long)(iova + size - 1));
+	if (r->kind == RANGE_MAPPED)
+		printf("%08x-%08llx", r->phys,
+		       (unsigned long long)(r->phys + size - 1));
+	else if (r->kind == RANGE_UNMAPPED)
+		printf("%-17s", "unmapped");
+	else
+		printf("%-17s", "invalid");
+	printf(" %8zu\n", r->pages);
+}
+
+static void account(struct mmu_stats *st, const struct range *r,
+	size_t *area, size_t *hole)
+{
+	unsigned int b;
+
+	if (r->kind == RANGE_UNMAPPED) {
+		st->unmapped += r->pages;
+		if (*area)
+			st->areas++;
+		*area = 0;
+		*hole += r->pages;
+		return;
+	}
+
+	if (*hole) {
+		st->holes++;
+		if (*hole > st->largest_hole)
+			st->largest_hole = *hole;
+	}
+	*hole = 0;
+	*area += r->pages;
+	if (*area > st->largest_area)
+		st->largest_area = *area;
+
+	if (r->kind == RANGE_INVALID) {
+		st->invalid += r->pages;
+		return;
+	}
+
+	st->mapped += r->pages;
+	st->ranges++;
+	if (r->pages > st->largest_range)
+		st->largest_range = r->pages;
+	b = 63 - __builtin_clzll(r->pages);
+	st->buckets[b < NR_BUCKETS ? b : NR_BUCKETS - 1]++;
+}
+
+/*
+ * Walk the table, calling print_range() for each range unless @quiet,
+ * and gather the statistics.
+ */
+static void decode(const uint32_t *e, size_t n, uint32_t scratch,
+	uint64_t base, int format, int quiet, struct mmu_stats *st)
+{
+	struct range r, prev = { .pages = 0 };
+	size_t i, area = 0, hole = 0;
+
+	memset(st, 0, sizeof(*st));
+	st->entries = n;
+
+	for (i = 0; i < n; i += r.pages) {
+		r.first = i;
+		r.phys = e[i];
+		if (e[i] == 0 || e[i] == scratch) {
+			r.kind = RANGE_UNMAPPED;
+			r.pages = run_length(e + i, n - i, 0);
+		} else if (e[i] & (PAGE_SIZE - 1)) {
+			r.kind = RANGE_INVALID;
+			r.pages = 1;
+		} else {
+			r.kind = RANGE_MAPPED;
+			r.pages = run_length(e + i, n - i, PAGE_SIZE);
+		}
+
+		/* Unmapped runs of zeroes and the scratch page are one hole */
+		if (prev.pages && r.kind == prev.kind &&
+		    r.kind != RANGE_MAPPED) {
+			prev.pages += r.pages;
+			continue;
+		}
+
+		if (prev.pages) {
+			if (!quiet)
+				print_range(&prev, base, format, prev.first == 0);
+			account(st, &prev, &area, &hole);
+		}
+		prev = r;
+	}
+
+	if (prev.pages) {
+		if (!quiet)
+			print_range(&prev, base, format, prev.first == 0);
+		account(st, &prev, &area, &hole);
+	}
+	if (area)
+		st->areas++;
+	if (hole) {
+		st->holes++;
+		if (hole > st->largest_hole)
+			st->largest_hole = hole;
+	}
+}
+
+static double fragmentation(const struct mmu_stats *st)
+{
+	return st->unmapped ?
+		1.0 - (double)st->largest_hole / st->unmapped : 0.0;
+}
+
+static void show_text(const struct mmu_stats *st, uint64_t base,
+	uint32_t scratch)
+{
+	unsigned int b;
+
+	printf("=== Summary\n");
+	printf("IOVA:              %09llx-%09llx\n", (unsigned long long)base,
+	       (unsigned long long)(base + (uint64_t)st->entries * PAGE_SIZE - 1));
+	printf("Scratch page:      %08x\n", scratch);
+	printf("Entries:           %zu\n", st->entries);
+	printf("Mapped pages:      %zu\n", st->mapped);
+	printf("Unmapped pages:    %zu\n", st->unmapped);
+	printf("Invalid entries:   %zu\n", st->invalid);
+	printf("Ranges:            %zu, largest %zu pages, mean %.1f pages\n",
+	       st->ranges, st->largest_range,
+	       st->ranges ? (double)st->mapped / st->ranges : 0.0);
+	printf("Mapped areas:      %zu, largest %zu pages\n",
+	       st->areas, st->largest_area);
+	printf("Holes:             %zu, largest %zu pages\n",
+	       st->holes, st->largest_hole);
+	printf("Fragmentation:     %.3f\n", fragmentation(st));
+
+	printf("=== Range sizes\n");
+	for (b = 0; b < NR_BUCKETS; b++)
+		if (st->buckets[b])
+			printf("%8llu+ pages %10zu\n", 1ull << b, st->buckets[b]);
+}
+
+static void show_json(const struct mmu_stats *st, uint64_t base,
+	uint32_t scratch, int ranges)
+{
+	unsigned int b, n;
+
+	printf("%s\n  \"base\": %llu,\n", ranges ? "\n  ]," : "{",
+	       (unsigned long long)base);
+	printf("  \"scratch\": %u,\n", scratch);
+	printf("  \"entries\": %zu,\n", st->entries);
+	printf("  \"mapped_pages\": %zu,\n", st->mapped);
+	printf("  \"unmapped_pages\": %zu,\n", st->unmapped);
+	printf("  \"invalid_entries\": %zu,\n", st->invalid);
+	printf("  \"ranges\": %zu,\n", st->ranges);
+	printf("  \"largest_range_pages\": %zu,\n", st->largest_range);
+	printf("  \"areas\": %zu,\n", st->areas);
+	printf("  \"largest_area_pages\": %zu,\n", st->largest_area);
+	printf("  \"holes\": %zu,\n", st->holes);
+	printf("  \"largest_hole_pages\": %zu,\n", st->largest_hole);
+	printf("  \"fragmentation\": %.6f,\n", fragmentation(st));
+	printf("  \"range_pages_histogram\": {");
+	for (b = n = 0; b < NR_BUCKETS; b++)
+		if (st->buckets[b])
+			printf("%s\"%llu\": %zu", n++ ? ", " : "", 1ull << b,
+			       st->buckets[b]);
+	printf("}\n}\n");
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [--stats] [-b BASE] [-B SCRATCH] [-s] [-f text|json] DUMPFILE|MMUFILE\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	uint64_t base = MMUV1_BASE;
+	uint32_t scratch = 0;
+	int opt, format = OUT_TEXT, quiet = 0, have_scratch = 0, phase;
+	const uint32_t *table;
+	struct mmu_stats st;
+	size_t entries;
+
+	stats_init(&argc, argv);
+
+	while ((opt = getopt(argc, argv, "b:B:sf:")) != -1) {
+		switch (opt) {
+		case 'b':
+			base = strtoull(optarg, NULL, 0);
+			break;
+		case 'B':
+			scratch = strtoul(optarg, NULL, 0);
+			have_scratch = 1;
+			break;
+		case 's':
+			quiet = 1;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "text"))
+				format = OUT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				format = OUT_JSON;
+			else
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	phase = stats_begin("map");
+	table = open_table(argv[optind], &entries);
+	stats_end(phase, 0, 1);
+
+	if (!have_scratch) {
+		phase = stats_begin("scratch");
+		scratch = find_scratch(table, entries);
+		stats_end(phase, entries * sizeof(uint32_t), entries);
+	}
+
+	if (format == OUT_JSON && !quiet)
+		printf("{\n  \"map\": [");
+	else if (format == OUT_TEXT && !quiet)
+		printf("=== Ranges\n%-19s %-17s %8s\n", "IOVA", "Physical",
+		       "Pages");
+
+	phase = stats_begin("decode");
+	decode(table, entries, scratch, base, format, quiet, &st);
+	stats_end(phase, entries * sizeof(uint32_t), entries);
+
+	if (format == OUT_JSON)
+		show_json(&st, base, scratch, !quiet);
+	else
+		show_text(&st, base, scratch);
+
+	return 0;
+}
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdint.h>
 #include <sys/fcntl.h>
 #include <sys/mman.h>
@@ -7,6 +8,9 @@
 
 #include "etnaviv_dump.h"
 #include "hw/state.xml.h"
+#include "../cmd/vivcmd.h"
+#include "../info/chipdb.h"
+#include "../stats/stats.h"
 
 static const char *buf_name[] = {
 	"reg",
@@ -60,6 +64,97 @@ static const char *calstate[4] = {
 	"idle", "ldadr", "idxcalc", "",
 };
 
+static const char *feature_names[CHIP_FEATURE_WORDS] = {
+	"Features:",
+	"Minor features 0:",
+	"Minor features 1:",
+	"Minor features 2:",
+	"Minor features 3:",
+	"Minor features 4:",
+	"Minor features 5:",
+};
+
+static void show_chip(const struct etnaviv_dump_registers *regs,
+	unsigned int num)
+{
+	struct chip chip;
+	unsigned int w;
+
+	printf("=== Chip\n");
+	if (chip_from_registers(&chip, regs, num)) {
+		printf("No identity registers\n");
+		return;
+	}
+
+	printf("Model: GC%x rev 0x%04x%s\n", chip.model, chip.revision,
+		chipdb_lookup(chip.model, chip.revision) ? "" :
+		" (not in chip database)");
+	for (w = 0; w < CHIP_FEATURE_WORDS; w++) {
+		if (chip.known & (1 << w))
+			printf("%-17s 0x%08x%s\n", feature_names[w],
+				chip.features[w],
+				chip.from_db & (1 << w) ? " (database)" : "");
+		else
+			printf("%-17s unknown\n", feature_names[w]);
+	}
+	if (chip.pixel_pipes)
+		printf("Pixel pipes: %u\n", chip.pixel_pipes);
+}
+
+/* The last few commands up to the one the FE is fetching */
+#define CMD_HISTORY	16
+
+struct cmd_history {
+	uint32_t fetch;		/* word offset of the FE DMA address */
+	struct vivcmd_op op[CMD_HISTORY];
+	unsigned int nr;
+};
+
+static int cmd_history_op(void *priv, const struct vivcmd_op *op)
+{
+	struct cmd_history *h = priv;
+
+	h->op[h->nr++ % CMD_HISTORY] = *op;
+
+	return op->pos + op->nr_words > h->fetch;
+}
+
+static void show_cmds(const struct etnaviv_dump_object_header *hdr,
+	const void *file, uint32_t dma_addr)
+{
+	static const struct vivcmd_visitor visitor = {
+		.op = cmd_history_op,
+	};
+	struct vivcmd_stream s = {
+		.buf = file + hdr->file_offset,
+		.size = hdr->file_size / sizeof(uint32_t),
+	};
+	struct cmd_history h = {
+		.fetch = (dma_addr - hdr->iova) / sizeof(uint32_t),
+	};
+	unsigned int i, j;
+	int ret;
+
+	printf("=== Commands before %08x\n", dma_addr);
+	ret = vivcmd_parse(&s, &visitor, &h);
+
+	for (i = h.nr > CMD_HISTORY ? h.nr - CMD_HISTORY : 0; i < h.nr; i++) {
+		const struct vivcmd_op *op = &h.op[i % CMD_HISTORY];
+		const char *name = vivcmd_opcode_name(op->opcode);
+
+		printf("%c%08llx %-24s", ret == 1 && i == h.nr - 1 ? '*' : ' ',
+			(unsigned long long)hdr->iova + op->pos * 4, name);
+		for (j = 0; j < op->nr_words && j < 4; j++)
+			printf(" %08x", op->words[j]);
+		printf("%s\n", j < op->nr_words ? " ..." : "");
+	}
+	if (ret < 0)
+		printf(" %08llx %s: %08x\n",
+			(unsigned long long)hdr->iova + s.pos * 4,
+			errno == EINVAL ? "unknown opcode" : "truncated",
+			s.buf[s.pos]);
+}
+
 static char *reg_decode(char *buf, size_t size, uint32_t reg, uint32_t val)
 {
 	unsigned int i;
@@ -100,14 +195,17 @@ int main(int argc, char *argv[])
 	struct stat st;
 	unsigned int nr_bufs, i, err;
 	uint32_t dma_addr;
-	int dump_fd, dma_buf;
+	int dump_fd, dma_buf, phase;
+	uint64_t bytes;
 	void *file;
 
+	stats_init(&argc, argv);
 	if (argc < 2) {
-		fprintf(stderr, "Usage: %s DUMPFILE DIR\n", argv[0]);
+		fprintf(stderr, "Usage: %s [--stats] DUMPFILE DIR\n", argv[0]);
 		return 1;
 	}
 
+	phase = stats_begin("map");
 	dump_fd = open(argv[1], O_RDONLY);
 	if (dump_fd == -1) {
 		perror("open dump file");
@@ -128,6 +226,7 @@ int main(int argc, char *argv[])
 	}
 
 	close(dump_fd);
+	stats_end(phase, 0, 1);
 
 	hdr = file;
 	if (hdr[0].magic != ETDUMP_MAGIC) {
@@ -174,6 +273,7 @@ int main(int argc, char *argv[])
 		struct etnaviv_dump_registers *regs = file + h_regs->file_offset;
 		unsigned int num = h_regs->file_size / sizeof(*regs);
 
+		phase = stats_begin("registers");
 		printf("=== Register dump\n");
 		for (i = 0; i < num; i++) {
 			char buf[128], *p;
@@ -185,6 +285,8 @@ int main(int argc, char *argv[])
 				p ? " " : "", p ? p : "");
 		}
 
+		show_chip(regs, num);
+
 		/* Find the DMA buffer */
 		for (i = 0; i < nr_bufs; i++) {
 			if (hdr[i].type != ETDUMP_BUF_RING &&
@@ -194,6 +296,7 @@ int main(int argc, char *argv[])
 			    dma_addr < hdr[i].iova + hdr[i].file_size)
 				dma_buf = i;
 		}
+		stats_end(phase, h_regs->file_size, num);
 	}
 
 	printf("=== Buffers\n");
@@ -205,6 +308,8 @@ int main(int argc, char *argv[])
 			hdr[i].iova, hdr[i].file_size, hdr[i].file_size);
 	}
 
+	phase = stats_begin("write");
+	bytes = 0;
 	for (i = 0; i < nr_bufs; i++) {
 		char name[80];
 		int fd;
@@ -234,13 +339,22 @@ int main(int argc, char *argv[])
 			write(fd, file + hdr[i].file_offset,
 			      hdr[i].file_size);
 			close(fd);
+			bytes += hdr[i].file_size;
 		}
 	}
+	stats_end(phase, bytes, nr_bufs);
+
+	if (dma_buf >= 0) {
+		phase = stats_begin("commands");
+		show_cmds(&hdr[dma_buf], file, dma_addr);
+		stats_end(phase, hdr[dma_buf].file_size, 1);
+	}
 
 	if (h_mmu && h_bomap) {
 		uint32_t *mmu = file + h_mmu->file_offset;
 		uint64_t *bomap = file + h_bomap->file_offset;
 
+		phase = stats_begin("mmu");
 		printf("Checking MMU entries...");
 		err = 0;
 		for (i = 0; i < nr_bufs; i++) {
@@ -265,6 +379,7 @@ int main(int argc, char *argv[])
 		}
 		if (!err)
 			printf(" ok\n");
+		stats_end(phase, h_mmu->file_size, h_mmu->file_size / 4);
 	}
 
 	return 0;
@@ -0,0 +1,89 @@
+/*
+ * Chip feature database.  Devcoredumps carry the model, revision and
+ * the first two feature words in their registers; the compiled-in table
+ * supplies the rest for known chips, so dumps can be decoded for their
+ * chip without the device.
+ */
+#include <stddef.h>
+#include <string.h>
+
+#include "etnaviv_dump.h"
+#include "hw/common.xml.h"
+#include "chipdb.h"
+#include "chips.h"
+
+static unsigned int chip_hash(uint32_t model, uint32_t revision)
+{
+	return (model * 31 + revision) % CHIPS_HASH_SIZE;
+}
+
+const struct chip *chipdb_lookup(uint32_t model, uint32_t revision)
+{
+	unsigned int h = chip_hash(model, revision);
+
+	for (; chips_hash[h]; h = (h + 1) % CHIPS_HASH_SIZE) {
+		const struct chip *chip = &chips[chips_hash[h] - 1];
+
+		if (chip->model == model && chip->revision == revision)
+			return chip;
+	}
+
+	return NULL;
+}
+
+static const uint32_t feature_regs[CHIP_FEATURE_WORDS] = {
+	VIVS_HI_CHIP_FEATURE,
+	VIVS_HI_CHIP_MINOR_FEATURE_0,
+	VIVS_HI_CHIP_MINOR_FEATURE_1,
+	VIVS_HI_CHIP_MINOR_FEATURE_2,
+	VIVS_HI_CHIP_MINOR_FEATURE_3,
+	VIVS_HI_CHIP_MINOR_FEATURE_4,
+	VIVS_HI_CHIP_MINOR_FEATURE_5,
+};
+
+/*
+ * Identify the chip from a register dump.  Words in the dump win over
+ * the database, which fills in the others.  Returns -1 if the dump has
+ * no model and revision.
+ */
+int chip_from_registers(struct chip *chip,
+	const struct etnaviv_dump_registers *regs, unsigned int nr)
+{
+	const struct chip *db;
+	unsigned int i, w, found = 0;
+
+	memset(chip, 0, sizeof(*chip));
+
+	for (i = 0; i < nr; i++) {
+		if (regs[i].reg == VIVS_HI_CHIP_MODEL) {
+			chip->model = regs[i].value;
+			found |= 1;
+		} else if (regs[i].reg == VIVS_HI_CHIP_REV) {
+			chip->revision = regs[i].value;
+			found |= 2;
+		}
+		for (w = 0; w < CHIP_FEATURE_WORDS; w++) {
+			if (regs[i].reg == feature_regs[w]) {
+				chip->features[w] = regs[i].value;
+				chip->known |= 1 << w;
+			}
+		}
+	}
+
+	if (found != 3)
+		return -1;
+
+	db = chipdb_lookup(chip->model, chip->revision);
+	if (db) {
+		chip->pixel_pipes = db->pixel_pipes;
+		for (w = 0; w < CHIP_FEATURE_WORDS; w++) {
+			if (chip->known & (1 << w))
+				continue;
+			chip->features[w] = db->features[w];
+			chip->known |= 1 << w;
+			chip->from_db |= 1 << w;
+		}
+	}
+
+	return 0;
+}
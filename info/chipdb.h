@@ -0,0 +1,50 @@
+#ifndef CHIPDB_H
+#define CHIPDB_H
+
+#include <stdint.h>
+
+struct etnaviv_dump_registers;
+
+/* Feature words, in the order of ETNAVIV_PARAM_GPU_FEATURES_0-6 */
+enum {
+	CHIP_FEATURES,
+	CHIP_MINOR_FEATURES0,
+	CHIP_MINOR_FEATURES1,
+	CHIP_MINOR_FEATURES2,
+	CHIP_MINOR_FEATURES3,
+	CHIP_MINOR_FEATURES4,
+	CHIP_MINOR_FEATURES5,
+	CHIP_FEATURE_WORDS,
+};
+
+struct chip {
+	uint32_t model;
+	uint32_t revision;
+	uint32_t features[CHIP_FEATURE_WORDS];
+	unsigned int pixel_pipes;	/* 0 if unknown */
+	unsigned int known;		/* bit n set if features[n] is known */
+	unsigned int from_db;		/* bit n set if features[n] came from chipdb */
+};
+
+/* Identity registers of the HI block, as in state_hi.xml */
+#define VIVS_HI_CHIP_FEATURE			0x0000001c
+#define VIVS_HI_CHIP_MODEL			0x00000020
+#define VIVS_HI_CHIP_REV			0x00000024
+#define VIVS_HI_CHIP_MINOR_FEATURE_0		0x00000034
+#define VIVS_HI_CHIP_MINOR_FEATURE_1		0x00000074
+#define VIVS_HI_CHIP_MINOR_FEATURE_2		0x00000084
+#define VIVS_HI_CHIP_MINOR_FEATURE_3		0x00000088
+#define VIVS_HI_CHIP_MINOR_FEATURE_4		0x00000094
+#define VIVS_HI_CHIP_MINOR_FEATURE_5		0x000000a0
+
+const struct chip *chipdb_lookup(uint32_t model, uint32_t revision);
+int chip_from_registers(struct chip *chip,
+	const struct etnaviv_dump_registers *regs, unsigned int nr);
+
+static inline int chip_has(const struct chip *chip, unsigned int word,
+	uint32_t mask)
+{
+	return chip->known & (1 << word) && chip->features[word] & mask;
+}
+
+#endif
@@ -0,0 +1,57 @@
+# Generate the chip feature table and its hash index from chips.txt.
+# The hash must match chip_hash() in chipdb.c.
+
+function hex(s,	i, v) {
+	s = tolower(s)
+	sub(/^0x/, "", s)
+	v = 0
+	for (i = 1; i <= length(s); i++)
+		v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+	return v
+}
+
+BEGIN { n = 0 }
+
+/^[ \t]*#/ || NF == 0 { next }
+
+NF != 10 {
+	printf "%s:%d: expected 10 fields\n", FILENAME, FNR > "/dev/stderr"
+	err = 1
+	exit 1
+}
+
+{
+	model[n] = $1
+	revision[n] = $2
+	words[n] = $3 ", " $4 ", " $5 ", " $6 ", " $7 ", " $8 ", " $9
+	pipes[n] = $10
+	key[n] = hex(substr($1, 3)) * 31 + hex($2)
+	n++
+}
+
+END {
+	if (err)
+		exit 1
+	for (size = 16; size < 2 * n; size *= 2)
+		;
+	for (i = 0; i < n; i++) {
+		h = key[i] % size
+		while (h in slot)
+			h = (h + 1) % size
+		slot[h] = i + 1
+	}
+
+	print "/* Generated from info/chips.txt by info/chips.awk, do not edit */"
+	print "static const struct chip chips[] = {"
+	for (i = 0; i < n; i++)
+		printf "\t{ chipModel_%s, %s, { %s }, %s, 0x7f },\n",
+		       model[i], revision[i], words[i], pipes[i]
+	print "};"
+	print ""
+	printf "#define CHIPS_HASH_SIZE %d\n", size
+	print "/* chips[] index + 1 by chip_hash(), with linear probing */"
+	printf "static const unsigned short chips_hash[CHIPS_HASH_SIZE] = {"
+	for (i = 0; i < size; i++)
+		printf "%s%s%d", i ? "," : "", i % 16 ? " " : "\n\t", slot[i]
+	print "\n};"
+}
@@ -0,0 +1,10 @@
+/* Generated from info/chips.txt by info/chips.awk, do not edit */
+static const struct chip chips[] = {
+	{ chipModel_GC2000, 0x5108, { 0xe0296cad, 0xc9799eff, 0x2efbf2d9, 0x00000000, 0x00000000, 0x00000000, 0x00000000 }, 2, 0x7f },
+};
+
+#define CHIPS_HASH_SIZE 16
+/* chips[] index + 1 by chip_hash(), with linear probing */
+static const unsigned short chips_hash[CHIPS_HASH_SIZE] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0
+};
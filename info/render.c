@@ -0,0 +1,65 @@
+/* Find and open etnaviv render nodes */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+#include "render.h"
+
+static int open_etnaviv(const char *name)
+{
+	drmVersionPtr version;
+	int fd, rc;
+
+	fd = open(name, O_RDWR | O_CLOEXEC);
+	if (fd == -1)
+		return -1;
+
+	version = drmGetVersion(fd);
+	if (version) {
+		rc = strcmp(version->name, "etnaviv");
+		drmFreeVersion(version);
+
+		if (rc == 0)
+			return fd;
+	}
+
+	close(fd);
+	errno = ENODEV;
+
+	return -1;
+}
+
+/*
+ * Open @device, or else the first etnaviv render node, whose path is
+ * stored in @name if given.
+ */
+int render_open(const char *device, char *name, size_t size)
+{
+	char buf[64];
+	int minor, fd;
+
+	if (device) {
+		if (name)
+			snprintf(name, size, "%s", device);
+		return open_etnaviv(device);
+	}
+
+	for (minor = 0; minor < 64; minor++) {
+		snprintf(buf, sizeof(buf), "%s/renderD%d",
+			 DRM_DIR_NAME, 128 + minor);
+
+		fd = open_etnaviv(buf);
+		if (fd != -1) {
+			if (name)
+				snprintf(name, size, "%s", buf);
+			return fd;
+		}
+	}
+
+	errno = ENODEV;
+
+	return -1;
+}
@@ -0,0 +1,8 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stddef.h>
+
+int render_open(const char *device, char *name, size_t size);
+
+#endif
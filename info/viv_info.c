@@ -1,4 +1,6 @@
 /* Get info about vivante device */
+#include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -14,6 +16,9 @@
 
 #include "etnaviv_drm.h"
 #include "hw/common.xml.h"
+#include "render.h"
+#include "viv_info.h"
+#include "../stats/stats.h"
 
 #ifdef __GNUC__
 #define __maybe_unused __attribute__((unused))
@@ -44,6 +49,7 @@ static void print_features(uint32_t feature, const struct feature *f, size_t n)
 
 struct param {
 	uint32_t param;
+	const char *name;
 	const char *format;
 	struct feature *tbl;
 	size_t tbl_sz;
@@ -53,127 +59,237 @@ struct param {
 static struct param params[] = {
 	{
 		.param = ETNAVIV_PARAM_GPU_MODEL,
+		.name = "model",
 		.format = "Chip model: GC%x\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_REVISION,
+		.name = "revision",
 		.format = "Chip revision: 0x%04x\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_0,
+		.name = "features0",
 		.format = "Chip features: 0x%08x\n",
 		.tbl = vivante_chipFeatures,
 		.tbl_sz = ARRAY_SIZE(vivante_chipFeatures),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_1,
+		.name = "features1",
 		.format = "Chip minor features 0: 0x%08x\n",
 		.tbl = vivante_chipMinorFeatures0,
 		.tbl_sz = ARRAY_SIZE(vivante_chipMinorFeatures0),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_2,
+		.name = "features2",
 		.format = "Chip minor features 1: 0x%08x\n",
 		.tbl = vivante_chipMinorFeatures1,
 		.tbl_sz = ARRAY_SIZE(vivante_chipMinorFeatures1),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_3,
+		.name = "features3",
 		.format = "Chip minor features 2: 0x%08x\n",
 		.tbl = vivante_chipMinorFeatures2,
 		.tbl_sz = ARRAY_SIZE(vivante_chipMinorFeatures2),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_4,
+		.name = "features4",
 		.format = "Chip minor features 3: 0x%08x\n",
 		.tbl = vivante_chipMinorFeatures3,
 		.tbl_sz = ARRAY_SIZE(vivante_chipMinorFeatures3),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_5,
+		.name = "features5",
 		.format = "Chip minor features 4: 0x%08x\n",
 		.tbl = vivante_chipMinorFeatures4,
 		.tbl_sz = ARRAY_SIZE(vivante_chipMinorFeatures4),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_FEATURES_6,
+		.name = "features6",
 		.format = "Chip minor features 5: 0x%08x\n",
 		.tbl = vivante_chipMinorFeatures5,
 		.tbl_sz = ARRAY_SIZE(vivante_chipMinorFeatures5),
 	}, {
 		.param = ETNAVIV_PARAM_GPU_STREAM_COUNT,
+		.name = "stream_count",
 		.format = "Stream count: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_REGISTER_MAX,
+		.name = "register_max",
 		.format = "Register max: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_THREAD_COUNT,
+		.name = "thread_count",
 		.format = "Thread count: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_SHADER_CORE_COUNT,
+		.name = "shader_core_count",
 		.format = "Shader core count: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_VERTEX_CACHE_SIZE,
+		.name = "vertex_cache_size",
 		.format = "Vertex cache size: %ukB\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_VERTEX_OUTPUT_BUFFER_SIZE,
+		.name = "vertex_output_buffer_size",
 		.format = "Vertex output buffer size: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_PIXEL_PIPES,
+		.name = "pixel_pipes",
 		.format = "Pixel pipes: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_INSTRUCTION_COUNT,
+		.name = "instruction_count",
 		.format = "Instruction count: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_NUM_CONSTANTS,
+		.name = "num_constants",
 		.format = "Num constants: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_BUFFER_SIZE,
+		.name = "buffer_size",
 		.format = "Buffer size: %u\n",
 	}, {
 		.param = ETNAVIV_PARAM_GPU_NUM_VARYINGS,
+		.name = "num_varyings",
 		.format = "Varyings count: %u\n",
 	},
 };
 
-static int open_render(void)
+struct gpu_info {
+	struct viv_info_header hdr;
+	struct viv_info_core core[ETNA_MAX_PIPES];
+};
+
+static void query_gpu(int fd, struct gpu_info *info)
 {
-	drmVersionPtr version;
-	char buf[64];
-	int minor, fd, rc;
+	struct drm_etnaviv_param req;
+	int i, pipe;
 
-	for (minor = 0; minor < 64; minor++) {
-		snprintf(buf, sizeof(buf), "%s/renderD%d",
-			 DRM_DIR_NAME, 128 + minor);
+	for (pipe = 0; pipe < ETNA_MAX_PIPES; pipe++) {
+		struct viv_info_core *core = &info->core[info->hdr.nr_cores];
 
-		fd = open(buf, O_RDWR);
-		if (fd == -1)
-			continue;
+		memset(core, 0, sizeof(*core));
+		core->pipe = pipe;
+		req.pipe = pipe;
 
-		version = drmGetVersion(fd);
-		if (version) {
-			rc = strcmp(version->name, "etnaviv");
-			drmFreeVersion(version);
+		/* params[0] is the model, which every core has */
+		for (i = 0; i < ARRAY_SIZE(params); i++) {
+			req.param = params[i].param;
+			if (drmCommandWriteRead(fd, DRM_ETNAVIV_GET_PARAM, &req, sizeof(req))) {
+				if (i == 0)
+					break;
+				continue;
+			}
 
-			if (rc == 0)
-				return fd;
+			core->valid |= 1u << req.param;
+			core->value[req.param] = req.value;
 		}
 
-		close(fd);
+		if (core->valid)
+			info->hdr.nr_cores++;
 	}
+}
+
+static int read_boot_id(char *boot_id, size_t size)
+{
+	FILE *f;
+	int ok;
+
+	f = fopen("/proc/sys/kernel/random/boot_id", "r");
+	if (!f)
+		return -1;
 
-	return -1;
+	ok = fgets(boot_id, size, f) != NULL;
+	fclose(f);
+	if (!ok)
+		return -1;
+
+	boot_id[strcspn(boot_id, "\n")] = '\0';
+
+	return 0;
 }
 
-static void show_one_gpu(int fd, int pipe)
+/*
+ * The cache holds what one run read: it is only used in the same boot,
+ * and for the same render node if one was asked for.
+ */
+static int cache_load(const char *name, const char *device,
+	const char *boot_id, struct gpu_info *info)
 {
-	struct drm_etnaviv_param req;
-	int i;
+	size_t size;
+	FILE *f;
+	int ok;
 
-	req.pipe = pipe;
+	f = fopen(name, "r");
+	if (!f)
+		return -1;
+
+	ok = fread(&info->hdr, sizeof(info->hdr), 1, f) == 1 &&
+	     memcmp(info->hdr.magic, VIV_INFO_MAGIC, sizeof(VIV_INFO_MAGIC)) == 0 &&
+	     info->hdr.version == VIV_INFO_VERSION &&
+	     info->hdr.nr_cores <= ETNA_MAX_PIPES &&
+	     strncmp(info->hdr.boot_id, boot_id, sizeof(info->hdr.boot_id)) == 0 &&
+	     (!device || strncmp(info->hdr.device, device, sizeof(info->hdr.device)) == 0);
+	if (ok) {
+		size = info->hdr.nr_cores;
+		ok = fread(info->core, sizeof(info->core[0]), size, f) == size;
+	}
+	fclose(f);
+
+	info->hdr.device[sizeof(info->hdr.device) - 1] = '\0';
+
+	return ok ? 0 : -1;
+}
+
+/* Bytes of the header and cores, as in the cache file */
+static size_t info_size(const struct gpu_info *info)
+{
+	return sizeof(info->hdr) + info->hdr.nr_cores * sizeof(info->core[0]);
+}
+
+static int write_info(int fd, const struct gpu_info *info)
+{
+	size_t size = info->hdr.nr_cores * sizeof(info->core[0]);
+
+	if (write(fd, &info->hdr, sizeof(info->hdr)) != sizeof(info->hdr) ||
+	    write(fd, info->core, size) != size)
+		return -1;
+
+	return 0;
+}
+
+/* Replace the cache atomically, so concurrent readers never see half */
+static void cache_store(const char *name, const struct gpu_info *info)
+{
+	char tmp[PATH_MAX];
+	int fd;
+
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", name);
+	fd = mkstemp(tmp);
+	if (fd == -1) {
+		fprintf(stderr, "viv_info: %s: %m\n", tmp);
+		return;
+	}
+
+	if (write_info(fd, info) || fchmod(fd, 0644) || close(fd) ||
+	    rename(tmp, name)) {
+		fprintf(stderr, "viv_info: %s: %m\n", name);
+		unlink(tmp);
+	}
+}
+
+static void show_one_gpu(const struct viv_info_core *core)
+{
+	int i;
 
-	printf("********** core: %i ***********\n", pipe);
+	printf("********** core: %i ***********\n", core->pipe);
 	printf("* Chip identity:\n");
 	for (i = 0; i < ARRAY_SIZE(params); i++) {
 		uint32_t val;
 
-		req.param = params[i].param;
-		if (drmCommandWriteRead(fd, DRM_ETNAVIV_GET_PARAM, &req, sizeof(req)))
+		if (!(core->valid & (1u << params[i].param)))
 			continue;
 
-		val = req.value;
+		val = core->value[params[i].param];
 
 		printf(params[i].format, val);
 		if (params[i].tbl)
@@ -182,28 +298,189 @@ static void show_one_gpu(int fd, int pipe)
 	printf("\n");
 }
 
-int main()
+static void print_json_string(const char *str)
 {
-	struct drm_etnaviv_param req;
-	int fd, pipe;
+	putchar('"');
+	for (; *str; str++) {
+		if (*str == '"' || *str == '\\')
+			printf("\\%c", *str);
+		else if ((unsigned char)*str < 0x20)
+			printf("\\u%04x", *str);
+		else
+			putchar(*str);
+	}
+	putchar('"');
+}
 
-	fd = open_render();
-	if (fd == -1) {
-		perror("Cannot open device");
-		exit(1);
+static void show_json(const struct gpu_info *info)
+{
+	const struct viv_info_core *core;
+	const struct feature *f;
+	unsigned int n;
+	const char *sep;
+	int i, j;
+
+	printf("{\n\t\"device\": ");
+	print_json_string(info->hdr.device);
+	printf(",\n\t\"cores\": [");
+
+	for (n = 0; n < info->hdr.nr_cores; n++) {
+		core = &info->core[n];
+		printf("%s\n\t\t{\n\t\t\t\"pipe\": %u", n ? "," : "", core->pipe);
+
+		for (i = 0; i < ARRAY_SIZE(params); i++)
+			if (core->valid & (1u << params[i].param))
+				printf(",\n\t\t\t\"%s\": %llu", params[i].name,
+				       (unsigned long long)core->value[params[i].param]);
+
+		printf(",\n\t\t\t\"features\": [");
+		sep = "";
+		for (i = 0; i < ARRAY_SIZE(params); i++) {
+			if (!params[i].tbl ||
+			    !(core->valid & (1u << params[i].param)))
+				continue;
+
+			f = params[i].tbl;
+			for (j = 0; j < params[i].tbl_sz; j++, f++) {
+				if (!(core->value[params[i].param] & f->mask))
+					continue;
+				printf("%s\"%s\"", sep, f->name);
+				sep = ", ";
+			}
+		}
+		printf("]\n\t\t}");
 	}
 
-	for (pipe = 0; pipe < 5; pipe++) {
-		req.pipe = pipe;
-		req.param = ETNAVIV_PARAM_GPU_MODEL;
-		if (drmCommandWriteRead(fd, DRM_ETNAVIV_GET_PARAM, &req, sizeof(req)))
-			continue;
+	printf("\n\t]\n}\n");
+}
+
+/* A line for info/chips.txt */
+static void show_chipdb(const struct gpu_info *info)
+{
+	const struct viv_info_core *core;
+	unsigned int n, i;
 
-		show_one_gpu(fd, pipe);
+	for (n = 0; n < info->hdr.nr_cores; n++) {
+		core = &info->core[n];
+		printf("GC%llx\t0x%04llx",
+		       (unsigned long long)core->value[ETNAVIV_PARAM_GPU_MODEL],
+		       (unsigned long long)core->value[ETNAVIV_PARAM_GPU_REVISION]);
+		for (i = ETNAVIV_PARAM_GPU_FEATURES_0;
+		     i <= ETNAVIV_PARAM_GPU_FEATURES_6; i++)
+			printf("\t0x%08llx", (unsigned long long)core->value[i]);
+		printf("\t%llu\n",
+		       (unsigned long long)core->value[ETNAVIV_PARAM_GPU_PIXEL_PIPES]);
 	}
+}
 
-	close(fd);
+enum {
+	OUT_TEXT,
+	OUT_JSON,
+	OUT_BINARY,
+	OUT_CHIPDB,
+};
 
-	return 0;
+static void usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [--stats] [-d DEVICE] [-f text|json|binary|chipdb] [-c CACHE]\n",
+		prog);
+	exit(1);
 }
 
+int main(int argc, char *argv[])
+{
+	const char *device = NULL, *cache = NULL;
+	struct gpu_info info;
+	char boot_id[sizeof(info.hdr.boot_id)] = "";
+	int opt, fd, format = OUT_TEXT, cached, phase;
+	unsigned int n;
+
+	stats_init(&argc, argv);
+	while ((opt = getopt(argc, argv, "d:f:c:")) != -1) {
+		switch (opt) {
+		case 'd':
+			device = optarg;
+			break;
+		case 'f':
+			if (!strcmp(optarg, "text"))
+				format = OUT_TEXT;
+			else if (!strcmp(optarg, "json"))
+				format = OUT_JSON;
+			else if (!strcmp(optarg, "binary"))
+				format = OUT_BINARY;
+			else if (!strcmp(optarg, "chipdb"))
+				format = OUT_CHIPDB;
+			else
+				usage(argv[0]);
+			break;
+		case 'c':
+			cache = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	if (optind != argc ||
+	    (device && strlen(device) >= sizeof(info.hdr.device)))
+		usage(argv[0]);
+
+	/* Without a boot ID, a cache could outlive a kernel change */
+	if (read_boot_id(boot_id, sizeof(boot_id)))
+		cache = NULL;
+
+	phase = stats_begin("cache");
+	cached = cache && !cache_load(cache, device, boot_id, &info);
+	stats_end(phase, cached ? info_size(&info) : 0, cached);
+
+	if (!cached) {
+		memset(&info, 0, sizeof(info));
+		memcpy(info.hdr.magic, VIV_INFO_MAGIC, sizeof(VIV_INFO_MAGIC));
+		info.hdr.version = VIV_INFO_VERSION;
+		strcpy(info.hdr.boot_id, boot_id);
+
+		phase = stats_begin("open");
+		fd = render_open(device, info.hdr.device,
+				 sizeof(info.hdr.device));
+		if (fd == -1) {
+			perror("Cannot open device");
+			exit(1);
+		}
+		stats_end(phase, 0, 1);
+
+		phase = stats_begin("query");
+		query_gpu(fd, &info);
+		close(fd);
+		stats_end(phase, 0, info.hdr.nr_cores);
+
+		if (cache) {
+			phase = stats_begin("store");
+			cache_store(cache, &info);
+			stats_end(phase, info_size(&info), 1);
+		}
+	}
+
+	phase = stats_begin("output");
+	switch (format) {
+	case OUT_TEXT:
+		for (n = 0; n < info.hdr.nr_cores; n++)
+			show_one_gpu(&info.core[n]);
+		break;
+	case OUT_JSON:
+		show_json(&info);
+		break;
+	case OUT_CHIPDB:
+		show_chipdb(&info);
+		break;
+	case OUT_BINARY:
+		if (write_info(1, &info)) {
+			perror("write");
+			exit(1);
+		}
+		break;
+	}
+	stats_end(phase, format == OUT_BINARY ? info_size(&info) : 0,
+		  info.hdr.nr_cores);
+
+	return 0;
+}
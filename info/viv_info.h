@@ -0,0 +1,28 @@
+#ifndef VIV_INFO_H
+#define VIV_INFO_H
+
+#include <stdint.h>
+
+/*
+ * viv_info -f binary output, which is also the layout of its cache file:
+ * a header followed by nr_cores cores.  Fields are in host byte order.
+ */
+#define VIV_INFO_MAGIC		"VIVINFO"
+#define VIV_INFO_VERSION	1
+#define VIV_INFO_MAX_PARAMS	32
+
+struct viv_info_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t nr_cores;
+	char boot_id[40];	/* kernel boot ID when read, may be empty */
+	char device[64];	/* render node */
+};
+
+struct viv_info_core {
+	uint32_t pipe;
+	uint32_t valid;		/* bit n set if ETNAVIV_PARAM n was read */
+	uint64_t value[VIV_INFO_MAX_PARAMS];	/* indexed by ETNAVIV_PARAM */
+};
+
+#endif
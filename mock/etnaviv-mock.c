@@ -0,0 +1,790 @@
+/*
+ * A mock etnaviv render node, for running the tools and benchmarks
+ * without a GPU:
+ *
+ *   LD_PRELOAD=mock/libetnaviv-mock.so ETNAVIV_MOCK_PROFILE=FILE info/viv_info
+ *
+ * Opens of the render node (ETNAVIV_MOCK_DEVICE, /dev/dri/renderD128 by
+ * default) are claimed, and the DRM and etnaviv ioctls on the returned fd
+ * are answered from a chip profile, or a built-in GC2000 without one.
+ *
+ * The fd is a memfd that holds every BO of the file but userptr ones, so
+ * mmap() at the offset GEM_INFO returns needs no help.  Command streams are copied and
+ * relocated as the kernel would, but not executed: each core is a queue
+ * on which a submit completes the profile's exec latency after the one
+ * before it, and fences and BOs are busy until then.  The ioctls spin
+ * for their own latencies, so timings are reproducible; a random exec
+ * jitter and a wakeup delay of blocking waits can be added on top.
+ */
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "etnaviv_drm.h"
+
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
+
+#define MAX_FDS		1024
+#define NR_FENCES	65536	/* completion times kept per core */
+#define GPU_VA_BASE	0x10000000u
+#define PAGE_SIZE	4096u
+
+struct core {
+	int present;
+	uint64_t param[ETNAVIV_PARAM_GPU_NUM_VARYINGS + 1];
+	uint32_t seqno;
+	uint64_t last_done;
+	uint64_t *done;		/* completion time of fence n, ring */
+};
+
+/* Latencies, in ns */
+struct latency {
+	uint64_t submit;
+	uint64_t exec;
+	uint64_t exec_jitter;	/* up to this much more exec, at random */
+	uint64_t wake;		/* blocking waits return this late */
+	uint64_t gem_new;
+	uint64_t cpu_prep;
+};
+
+struct bo {
+	int valid;
+	int userptr;		/* not in the memfd, cannot be mapped */
+	uint64_t offset;
+	uint64_t size;
+	unsigned int pipe;
+	uint32_t fence;
+};
+
+struct file {
+	struct bo *bos;
+	unsigned int nr_bos, max_bos;
+	uint64_t mem_size;
+	void *stream;		/* copy of the last submitted stream */
+	size_t stream_size;
+};
+
+static const struct {
+	const char *name;
+	unsigned int param;
+} param_names[] = {
+	{ "model", ETNAVIV_PARAM_GPU_MODEL },
+	{ "revision", ETNAVIV_PARAM_GPU_REVISION },
+	{ "features0", ETNAVIV_PARAM_GPU_FEATURES_0 },
+	{ "features1", ETNAVIV_PARAM_GPU_FEATURES_1 },
+	{ "features2", ETNAVIV_PARAM_GPU_FEATURES_2 },
+	{ "features3", ETNAVIV_PARAM_GPU_FEATURES_3 },
+	{ "features4", ETNAVIV_PARAM_GPU_FEATURES_4 },
+	{ "features5", ETNAVIV_PARAM_GPU_FEATURES_5 },
+	{ "features6", ETNAVIV_PARAM_GPU_FEATURES_6 },
+	{ "stream_count", ETNAVIV_PARAM_GPU_STREAM_COUNT },
+	{ "register_max", ETNAVIV_PARAM_GPU_REGISTER_MAX },
+	{ "thread_count", ETNAVIV_PARAM_GPU_THREAD_COUNT },
+	{ "vertex_cache_size", ETNAVIV_PARAM_GPU_VERTEX_CACHE_SIZE },
+	{ "shader_core_count", ETNAVIV_PARAM_GPU_SHADER_CORE_COUNT },
+	{ "pixel_pipes", ETNAVIV_PARAM_GPU_PIXEL_PIPES },
+	{ "vertex_output_buffer_size",
+	  ETNAVIV_PARAM_GPU_VERTEX_OUTPUT_BUFFER_SIZE },
+	{ "buffer_size", ETNAVIV_PARAM_GPU_BUFFER_SIZE },
+	{ "instruction_count", ETNAVIV_PARAM_GPU_INSTRUCTION_COUNT },
+	{ "num_constants", ETNAVIV_PARAM_GPU_NUM_CONSTANTS },
+	{ "num_varyings", ETNAVIV_PARAM_GPU_NUM_VARYINGS },
+};
+
+/* The i.MX6Q GC2000, used when no profile is given */
+static const char default_profile[] =
+	"core\n"
+	"model 0x2000\n"
+	"revision 0x5108\n"
+	"features0 0xe0296cad\n"
+	"features1 0xc9799eff\n"
+	"features2 0x2efbf2d9\n"
+	"stream_count 8\n"
+	"register_max 64\n"
+	"thread_count 1024\n"
+	"vertex_cache_size 16\n"
+	"shader_core_count 4\n"
+	"pixel_pipes 2\n"
+	"vertex_output_buffer_size 1024\n"
+	"buffer_size 0\n"
+	"instruction_count 512\n"
+	"num_constants 168\n"
+	"num_varyings 12\n"
+	"latency_submit 20\n"
+	"latency_exec 200\n"
+	"latency_gem_new 5\n"
+	"latency_cpu_prep 2\n";
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static const char *device = "/dev/dri/renderD128";
+static struct core cores[ETNA_MAX_PIPES];
+static struct latency latency;
+static struct file *files[MAX_FDS];
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_open64)(const char *, int, ...);
+static int (*real_openat)(int, const char *, int, ...);
+static int (*real_close)(int);
+static int (*real_ioctl)(int, unsigned long, ...);
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void spin(uint64_t ns)
+{
+	uint64_t end = now_ns() + ns;
+
+	while (ns && now_ns() < end)
+		;
+}
+
+static void profile_error(const char *name, unsigned int line,
+	const char *msg)
+{
+	fprintf(stderr, "etnaviv-mock: %s:%u: %s\n", name, line, msg);
+	exit(1);
+}
+
+static void profile_parse(const char *name, const char *text)
+{
+	struct core *core = NULL;
+	unsigned int line = 0, nr_cores = 0, i;
+	const char *p, *end;
+
+	for (p = text; *p; p = *end ? end + 1 : end) {
+		char key[64];
+		unsigned long long val;
+		int n;
+
+		end = strchrnul(p, '\n');
+		line++;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p == end || *p == '#')
+			continue;
+
+		if (!strncmp(p, "core", 4) && (p + 4 == end || p[4] == ' ' ||
+					      p[4] == '\t')) {
+			if (nr_cores == ETNA_MAX_PIPES)
+				profile_error(name, line, "too many cores");
+			core = &cores[nr_cores++];
+			core->present = 1;
+			continue;
+		}
+
+		if (sscanf(p, "%63s %lli%n", key, &val, &n) != 2 ||
+		    p + n > end)
+			profile_error(name, line, "expected KEY VALUE");
+
+		if (!strncmp(key, "latency_", 8)) {
+			uint64_t ns = val * 1000;
+
+			if (!strcmp(key + 8, "submit"))
+				latency.submit = ns;
+			else if (!strcmp(key + 8, "exec"))
+				latency.exec = ns;
+			else if (!strcmp(key + 8, "exec_jitter"))
+				latency.exec_jitter = ns;
+			else if (!strcmp(key + 8, "wake"))
+				latency.wake = ns;
+			else if (!strcmp(key + 8, "gem_new"))
+				latency.gem_new = ns;
+			else if (!strcmp(key + 8, "cpu_prep"))
+				latency.cpu_prep = ns;
+			else
+				profile_error(name, line, "unknown latency");
+			continue;
+		}
+
+		for (i = 0; i < ARRAY_SIZE(param_names); i++)
+			if (!strcmp(key, param_names[i].name))
+				break;
+		if (i == ARRAY_SIZE(param_names))
+			profile_error(name, line, "unknown key");
+		if (!core)
+			profile_error(name, line, "parameter outside a core");
+		core->param[param_names[i].param] = val;
+	}
+
+	if (!nr_cores)
+		profile_error(name, line, "no cores");
+
+	for (i = 0; i < nr_cores; i++) {
+		cores[i].done = calloc(NR_FENCES, sizeof(*cores[i].done));
+		if (!cores[i].done)
+			profile_error(name, line, "out of memory");
+	}
+}
+
+static void mock_init(void)
+{
+	const char *name = getenv("ETNAVIV_MOCK_PROFILE");
+	char *text = NULL;
+	size_t size = 0;
+	FILE *f;
+
+	real_open = dlsym(RTLD_NEXT, "open");
+	real_open64 = dlsym(RTLD_NEXT, "open64");
+	real_openat = dlsym(RTLD_NEXT, "openat");
+	real_close = dlsym(RTLD_NEXT, "close");
+	real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+
+	if (getenv("ETNAVIV_MOCK_DEVICE"))
+		device = getenv("ETNAVIV_MOCK_DEVICE");
+
+	if (!name) {
+		profile_parse("built-in", default_profile);
+		return;
+	}
+
+	f = fopen(name, "r");
+	if (!f || getdelim(&text, &size, '\0', f) < 0) {
+		fprintf(stderr, "etnaviv-mock: %s: %m\n", name);
+		exit(1);
+	}
+	fclose(f);
+	profile_parse(name, text);
+	free(text);
+}
+
+static int mock_open(int flags)
+{
+	struct file *file;
+	int fd;
+
+	file = calloc(1, sizeof(*file));
+	if (!file) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	fd = memfd_create("etnaviv-mock", flags & O_CLOEXEC ? MFD_CLOEXEC : 0);
+	if (fd == -1 || fd >= MAX_FDS) {
+		if (fd != -1) {
+			real_close(fd);
+			errno = EMFILE;
+		}
+		free(file);
+		return -1;
+	}
+
+	pthread_mutex_lock(&lock);
+	files[fd] = file;
+	pthread_mutex_unlock(&lock);
+
+	return fd;
+}
+
+int open(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	pthread_once(&once, mock_init);
+	if (!strcmp(path, device))
+		return mock_open(flags);
+
+	va_start(ap, flags);
+	if (flags & (O_CREAT | O_TMPFILE))
+		mode = va_arg(ap, mode_t);
+	va_end(ap);
+
+	return real_open(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	pthread_once(&once, mock_init);
+	if (!strcmp(path, device))
+		return mock_open(flags);
+
+	va_start(ap, flags);
+	if (flags & (O_CREAT | O_TMPFILE))
+		mode = va_arg(ap, mode_t);
+	va_end(ap);
+
+	return real_open64(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...)
+{
+	mode_t mode = 0;
+	va_list ap;
+
+	pthread_once(&once, mock_init);
+	if (!strcmp(path, device))
+		return mock_open(flags);
+
+	va_start(ap, flags);
+	if (flags & (O_CREAT | O_TMPFILE))
+		mode = va_arg(ap, mode_t);
+	va_end(ap);
+
+	return real_openat(dirfd, path, flags, mode);
+}
+
+int close(int fd)
+{
+	struct file *file = NULL;
+
+	pthread_once(&once, mock_init);
+	if (fd >= 0 && fd < MAX_FDS) {
+		pthread_mutex_lock(&lock);
+		file = files[fd];
+		files[fd] = NULL;
+		pthread_mutex_unlock(&lock);
+	}
+
+	if (file) {
+		free(file->bos);
+		free(file->stream);
+		free(file);
+	}
+
+	return real_close(fd);
+}
+
+static struct bo *lookup_bo(struct file *file, uint32_t handle)
+{
+	if (handle == 0 || handle > file->nr_bos ||
+	    !file->bos[handle - 1].valid)
+		return NULL;
+
+	return &file->bos[handle - 1];
+}
+
+static struct core *lookup_core(uint32_t pipe)
+{
+	if (pipe >= ETNA_MAX_PIPES || !cores[pipe].present)
+		return NULL;
+
+	return &cores[pipe];
+}
+
+/*
+ * Completion time of @fence in @done, or 0 once it is out of the ring.
+ * As the kernel does, a fence not issued yet is -EINVAL.
+ */
+static int fence_done(const struct core *core, uint32_t fence,
+	uint64_t *done)
+{
+	if (fence > core->seqno)
+		return -EINVAL;
+
+	if (fence == 0 || core->seqno - fence >= NR_FENCES)
+		*done = 0;
+	else
+		*done = core->done[fence % NR_FENCES];
+	return 0;
+}
+
+/* xorshift64, under the lock */
+static uint64_t random_u64(void)
+{
+	static uint64_t x = 0x9e3779b97f4a7c15ull;
+
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return x;
+}
+
+static uint64_t timespec_ns(const struct drm_etnaviv_timespec *ts)
+{
+	return ts->tv_sec * 1000000000ull + ts->tv_nsec;
+}
+
+/*
+ * Wait, unlocked, until @done has passed, or until the absolute
+ * @timeout, then oversleep by the wake latency as a scheduler might.
+ * Called and returns with the lock held.
+ */
+static int wait_until(uint64_t done, uint64_t timeout, int nonblock)
+{
+	uint64_t now = now_ns(), until;
+	struct timespec ts;
+
+	if (done <= now)
+		return 0;
+	if (nonblock)
+		return -EBUSY;
+
+	until = (done < timeout ? done : timeout) + latency.wake;
+	ts.tv_sec = until / 1000000000ull;
+	ts.tv_nsec = until % 1000000000ull;
+
+	pthread_mutex_unlock(&lock);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+	       EINTR)
+		;
+	pthread_mutex_lock(&lock);
+
+	return done <= timeout ? 0 : -ETIMEDOUT;
+}
+
+static int mock_version(struct drm_version *v)
+{
+	static const char name[] = "etnaviv", date[] = "20151214",
+			  desc[] = "etnaviv DRM";
+
+	v->version_major = 1;
+	v->version_minor = 1;
+	v->version_patchlevel = 0;
+
+#define COPY(s)								\
+	do {								\
+		if (v->s##_len && v->s)					\
+			memcpy(v->s, s, v->s##_len < sizeof(s) - 1 ?	\
+			       v->s##_len : sizeof(s) - 1);		\
+		v->s##_len = sizeof(s) - 1;				\
+	} while (0)
+	COPY(name);
+	COPY(date);
+	COPY(desc);
+#undef COPY
+
+	return 0;
+}
+
+static int mock_get_param(struct drm_etnaviv_param *req)
+{
+	struct core *core = lookup_core(req->pipe);
+
+	if (!core)
+		return -ENXIO;
+	if (req->param >= ARRAY_SIZE(core->param) ||
+	    (req->param > ETNAVIV_PARAM_GPU_FEATURES_6 &&
+	     req->param < ETNAVIV_PARAM_GPU_STREAM_COUNT) ||
+	    req->param == 0)
+		return -EINVAL;
+
+	req->value = core->param[req->param];
+
+	return 0;
+}
+
+static struct bo *alloc_bo(struct file *file)
+{
+	struct bo *bo;
+
+	if (file->nr_bos == file->max_bos) {
+		unsigned int max = file->max_bos ? 2 * file->max_bos : 64;
+
+		bo = realloc(file->bos, max * sizeof(*bo));
+		if (!bo)
+			return NULL;
+		file->bos = bo;
+		file->max_bos = max;
+	}
+
+	bo = &file->bos[file->nr_bos++];
+	memset(bo, 0, sizeof(*bo));
+	bo->valid = 1;
+
+	return bo;
+}
+
+static int mock_gem_new(int fd, struct file *file,
+	struct drm_etnaviv_gem_new *req)
+{
+	uint64_t size = (req->size + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+	struct bo *bo;
+
+	if (req->flags & ~(ETNA_BO_CACHE_MASK | ETNA_BO_FORCE_MMU) ||
+	    !(req->flags & ETNA_BO_CACHE_MASK) || size == 0)
+		return -EINVAL;
+
+	if (ftruncate(fd, file->mem_size + size))
+		return -errno;
+
+	bo = alloc_bo(file);
+	if (!bo)
+		return -ENOMEM;
+	bo->offset = file->mem_size;
+	bo->size = size;
+	file->mem_size += size;
+	req->handle = file->nr_bos;
+
+	return 0;
+}
+
+static int mock_gem_userptr(struct file *file,
+	struct drm_etnaviv_gem_userptr *req)
+{
+	struct bo *bo;
+
+	if (req->flags & ~(ETNA_USERPTR_READ | ETNA_USERPTR_WRITE) ||
+	    !req->flags || req->user_ptr % PAGE_SIZE ||
+	    req->user_size % PAGE_SIZE || !req->user_size)
+		return -EINVAL;
+
+	bo = alloc_bo(file);
+	if (!bo)
+		return -ENOMEM;
+	bo->userptr = 1;
+	bo->size = req->user_size;
+	req->handle = file->nr_bos;
+
+	return 0;
+}
+
+static int mock_gem_close(int fd, struct file *file,
+	struct drm_gem_close *req)
+{
+	struct bo *bo = lookup_bo(file, req->handle);
+
+	if (!bo)
+		return -EINVAL;
+
+	if (!bo->userptr)
+		fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+			  bo->offset, bo->size);
+	bo->valid = 0;
+
+	return 0;
+}
+
+static int mock_gem_info(struct file *file, struct drm_etnaviv_gem_info *req)
+{
+	struct bo *bo = lookup_bo(file, req->handle);
+
+	if (!bo || bo->userptr || req->pad)
+		return -EINVAL;
+
+	req->offset = bo->offset;
+
+	return 0;
+}
+
+static int mock_cpu_prep(struct file *file,
+	struct drm_etnaviv_gem_cpu_prep *req)
+{
+	struct bo *bo = lookup_bo(file, req->handle);
+	uint64_t done;
+
+	if (!bo || req->op & ~(ETNA_PREP_READ | ETNA_PREP_WRITE |
+			       ETNA_PREP_NOSYNC) ||
+	    !(req->op & (ETNA_PREP_READ | ETNA_PREP_WRITE)) ||
+	    fence_done(&cores[bo->pipe], bo->fence, &done))
+		return -EINVAL;
+
+	return wait_until(done, timespec_ns(&req->timeout),
+			  req->op & ETNA_PREP_NOSYNC);
+}
+
+static int mock_cpu_fini(struct file *file,
+	struct drm_etnaviv_gem_cpu_fini *req)
+{
+	return lookup_bo(file, req->handle) && !req->flags ? 0 : -EINVAL;
+}
+
+/* As the kernel does: copy the stream in, check it and relocate it */
+static int mock_submit(struct file *file, struct drm_etnaviv_gem_submit *req)
+{
+	struct drm_etnaviv_gem_submit_bo *bos =
+		(void *)(uintptr_t)req->bos;
+	const struct drm_etnaviv_gem_submit_reloc *relocs =
+		(const void *)(uintptr_t)req->relocs;
+	struct core *core = lookup_core(req->pipe);
+	uint32_t *stream, last = 0;
+	uint64_t now, done;
+	unsigned int i;
+
+	if (!core || req->exec_state > ETNA_PIPE_VG || req->stream_size == 0 ||
+	    req->stream_size % 4)
+		return -EINVAL;
+
+	for (i = 0; i < req->nr_bos; i++) {
+		struct bo *bo = lookup_bo(file, bos[i].handle);
+
+		if (!bo || bos[i].flags & ~(ETNA_SUBMIT_BO_READ |
+					    ETNA_SUBMIT_BO_WRITE))
+			return -EINVAL;
+		bos[i].presumed = GPU_VA_BASE + bo->offset;
+	}
+
+	if (file->stream_size < req->stream_size) {
+		stream = realloc(file->stream, req->stream_size);
+		if (!stream)
+			return -ENOMEM;
+		file->stream = stream;
+		file->stream_size = req->stream_size;
+	}
+	stream = file->stream;
+	memcpy(stream, (const void *)(uintptr_t)req->stream, req->stream_size);
+
+	for (i = 0; i < req->nr_relocs; i++) {
+		const struct drm_etnaviv_gem_submit_reloc *r = &relocs[i];
+		struct bo *bo;
+
+		if (r->submit_offset % 4 || r->flags ||
+		    r->submit_offset + 4 > req->stream_size ||
+		    (i && r->submit_offset < last) ||
+		    r->reloc_idx >= req->nr_bos)
+			return -EINVAL;
+		bo = lookup_bo(file, bos[r->reloc_idx].handle);
+		if (r->reloc_offset > bo->size - 4)
+			return -EINVAL;
+		stream[r->submit_offset / 4] = bos[r->reloc_idx].presumed +
+					       r->reloc_offset;
+		last = r->submit_offset;
+	}
+
+	now = now_ns();
+	done = (core->last_done > now ? core->last_done : now) + latency.exec;
+	if (latency.exec_jitter)
+		done += random_u64() % latency.exec_jitter;
+	core->last_done = done;
+	req->fence = ++core->seqno;
+	core->done[req->fence % NR_FENCES] = done;
+
+	for (i = 0; i < req->nr_bos; i++) {
+		struct bo *bo = lookup_bo(file, bos[i].handle);
+
+		bo->pipe = req->pipe;
+		bo->fence = req->fence;
+	}
+
+	return 0;
+}
+
+static int mock_wait_fence(struct drm_etnaviv_wait_fence *req)
+{
+	struct core *core = lookup_core(req->pipe);
+	uint64_t done;
+
+	if (!core || req->flags & ~ETNA_WAIT_NONBLOCK ||
+	    fence_done(core, req->fence, &done))
+		return -EINVAL;
+
+	return wait_until(done, timespec_ns(&req->timeout),
+			  req->flags & ETNA_WAIT_NONBLOCK);
+}
+
+static int mock_gem_wait(struct file *file, struct drm_etnaviv_gem_wait *req)
+{
+	struct bo *bo = lookup_bo(file, req->handle);
+	uint64_t done;
+
+	if (!bo || !lookup_core(req->pipe) ||
+	    req->flags & ~ETNA_WAIT_NONBLOCK ||
+	    fence_done(&cores[bo->pipe], bo->fence, &done))
+		return -EINVAL;
+
+	return wait_until(done, timespec_ns(&req->timeout),
+			  req->flags & ETNA_WAIT_NONBLOCK);
+}
+
+static int mock_ioctl(int fd, struct file *file, unsigned long request,
+	void *arg, uint64_t *delay)
+{
+#define ARG(type)	(_IOC_SIZE(request) == sizeof(type) ? (type *)arg : NULL)
+	if (_IOC_TYPE(request) != DRM_IOCTL_BASE)
+		return -ENOTTY;
+
+	switch (_IOC_NR(request)) {
+	case _IOC_NR(DRM_IOCTL_VERSION):
+		if (!ARG(struct drm_version))
+			break;
+		return mock_version(arg);
+	case _IOC_NR(DRM_IOCTL_GEM_CLOSE):
+		if (!ARG(struct drm_gem_close))
+			break;
+		return mock_gem_close(fd, file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GET_PARAM:
+		if (!ARG(struct drm_etnaviv_param))
+			break;
+		return mock_get_param(arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_NEW:
+		if (!ARG(struct drm_etnaviv_gem_new))
+			break;
+		*delay = latency.gem_new;
+		return mock_gem_new(fd, file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_INFO:
+		if (!ARG(struct drm_etnaviv_gem_info))
+			break;
+		return mock_gem_info(file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_CPU_PREP:
+		if (!ARG(struct drm_etnaviv_gem_cpu_prep))
+			break;
+		*delay = latency.cpu_prep;
+		return mock_cpu_prep(file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_CPU_FINI:
+		if (!ARG(struct drm_etnaviv_gem_cpu_fini))
+			break;
+		return mock_cpu_fini(file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_SUBMIT:
+		if (!ARG(struct drm_etnaviv_gem_submit))
+			break;
+		*delay = latency.submit;
+		return mock_submit(file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_WAIT_FENCE:
+		if (!ARG(struct drm_etnaviv_wait_fence))
+			break;
+		return mock_wait_fence(arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_USERPTR:
+		if (!ARG(struct drm_etnaviv_gem_userptr))
+			break;
+		*delay = latency.gem_new;
+		return mock_gem_userptr(file, arg);
+	case DRM_COMMAND_BASE + DRM_ETNAVIV_GEM_WAIT:
+		if (!ARG(struct drm_etnaviv_gem_wait))
+			break;
+		return mock_gem_wait(file, arg);
+	}
+#undef ARG
+
+	return -EINVAL;
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+	struct file *file = NULL;
+	uint64_t delay = 0;
+	va_list ap;
+	void *arg;
+	int ret;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	pthread_once(&once, mock_init);
+	pthread_mutex_lock(&lock);
+	if (fd >= 0 && fd < MAX_FDS)
+		file = files[fd];
+	if (!file) {
+		pthread_mutex_unlock(&lock);
+		return real_ioctl(fd, request, arg);
+	}
+	ret = mock_ioctl(fd, file, request, arg, &delay);
+	pthread_mutex_unlock(&lock);
+
+	spin(delay);
+
+	if (ret) {
+		errno = -ret;
+		return -1;
+	}
+
+	return 0;
+}
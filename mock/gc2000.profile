@@ -0,0 +1,34 @@
+# Chip profile for the etnaviv mock device: the i.MX6Q GC2000, as the
+# built-in default.  Each "core" line starts a core, numbered from 0 as
+# the pipes of GET_PARAM; the GET_PARAM values follow as KEY VALUE.
+# Parameters left out read back as 0.
+#
+# Latencies are in microseconds and shared by all cores:
+#   latency_submit	CPU time of a GEM_SUBMIT
+#   latency_exec	GPU time of a submit, after the one before it
+#   latency_exec_jitter	up to this much more GPU time, at random
+#   latency_wake	how late a blocking wait returns after its fence
+#   latency_gem_new	CPU time of a GEM_NEW
+#   latency_cpu_prep	CPU time of a GEM_CPU_PREP, besides waiting
+core
+model			0x2000
+revision		0x5108
+features0		0xe0296cad
+features1		0xc9799eff
+features2		0x2efbf2d9
+stream_count		8
+register_max		64
+thread_count		1024
+vertex_cache_size	16
+shader_core_count	4
+pixel_pipes		2
+vertex_output_buffer_size	1024
+buffer_size		0
+instruction_count	512
+num_constants		168
+num_varyings		12
+
+latency_submit		20
+latency_exec		200
+latency_gem_new		5
+latency_cpu_prep	2
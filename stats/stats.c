@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "stats.h"
+
+#define MAX_PHASES	16
+
+struct phase {
+	const char *name;
+	uint64_t ns;
+	uint64_t bytes;
+	uint64_t ops;
+	uint64_t start;
+};
+
+int stats_enabled;
+
+static const char *stats_tool;
+static const char *stats_file;
+static struct phase phases[MAX_PHASES];
+static unsigned int nr_phases;
+static uint64_t stats_t0;
+
+static uint64_t now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void stats_report(void)
+{
+	uint64_t total = now() - stats_t0;
+	struct rusage ru;
+	unsigned int i;
+	FILE *f = stderr;
+
+	if (stats_file) {
+		f = fopen(stats_file, "a");
+		if (!f) {
+			perror(stats_file);
+			return;
+		}
+	}
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	fprintf(f, "{\"tool\":\"%s\",\"phases\":[", stats_tool);
+	for (i = 0; i < nr_phases; i++) {
+		struct phase *p = &phases[i];
+
+		fprintf(f, "%s{\"phase\":\"%s\",\"seconds\":%.6f,"
+			"\"bytes\":%llu,\"ops\":%llu,\"mb_per_sec\":%.1f}",
+			i ? "," : "", p->name, p->ns / 1e9,
+			(unsigned long long)p->bytes,
+			(unsigned long long)p->ops,
+			p->ns ? p->bytes * 1e3 / p->ns : 0.0);
+	}
+	fprintf(f, "],\"total_seconds\":%.6f,\"peak_rss_kb\":%ld}\n",
+		total / 1e9, ru.ru_maxrss);
+
+	if (f != stderr)
+		fclose(f);
+}
+
+/*
+ * Enable statistics for --stats, which is removed from the arguments, or
+ * for VIV_STATS set to 1 to report to stderr or to a file to append to.
+ */
+void stats_init(int *argc, char *argv[])
+{
+	const char *env = getenv("VIV_STATS");
+	int i, j;
+
+	stats_tool = strrchr(argv[0], '/');
+	stats_tool = stats_tool ? stats_tool + 1 : argv[0];
+
+	if (env && *env && strcmp(env, "0")) {
+		stats_enabled = 1;
+		if (strcmp(env, "1"))
+			stats_file = env;
+	}
+
+	for (i = j = 1; i < *argc; i++) {
+		if (!strcmp(argv[i], "--"))
+			break;
+		if (!strcmp(argv[i], "--stats"))
+			stats_enabled = 1;
+		else
+			argv[j++] = argv[i];
+	}
+	while (i < *argc)
+		argv[j++] = argv[i++];
+	argv[j] = NULL;
+	*argc = j;
+
+	if (stats_enabled) {
+		stats_t0 = now();
+		atexit(stats_report);
+	}
+}
+
+/* Phases of the same name accumulate */
+int stats_start(const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr_phases; i++)
+		if (!strcmp(phases[i].name, name))
+			break;
+
+	if (i == nr_phases) {
+		if (nr_phases == MAX_PHASES)
+			return -1;
+		phases[nr_phases++].name = name;
+	}
+
+	phases[i].start = now();
+	return i;
+}
+
+void stats_stop(int phase, uint64_t bytes, uint64_t ops)
+{
+	struct phase *p = &phases[phase];
+
+	p->ns += now() - p->start;
+	p->bytes += bytes;
+	p->ops += ops;
+}
@@ -0,0 +1,30 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+/*
+ * Per-phase wall time and byte/op counters, enabled by --stats or by
+ * VIV_STATS in the environment, and printed at exit as one JSON object
+ * per run.  When disabled, a phase costs a test of stats_enabled.
+ */
+extern int stats_enabled;
+
+void stats_init(int *argc, char *argv[]);
+int stats_start(const char *name);
+void stats_stop(int phase, uint64_t bytes, uint64_t ops);
+
+/* Start a phase, returning its handle for stats_end(), or -1 */
+static inline int stats_begin(const char *name)
+{
+	return stats_enabled ? stats_start(name) : -1;
+}
+
+/* End a phase, having handled @bytes in @ops */
+static inline void stats_end(int phase, uint64_t bytes, uint64_t ops)
+{
+	if (phase >= 0)
+		stats_stop(phase, bytes, ops);
+}
+
+#endif